@@ -0,0 +1,243 @@
+/*
+    Timings for the file paths, each against the plain standard library
+    way of doing the same thing. Files are created in a tools_benchmarks
+    subdirectory of the first argument (the temporary directory by
+    default) and removed afterwards:
+
+        g++ -std=c++20 -O2 bench/benchmarks.cpp -o benchmarks -pthread && ./benchmarks [dir]
+
+    Every case runs five times and the best time is reported, so the
+    numbers describe warm page cache behaviour.
+*/
+
+#include "../src/tools.hpp"
+
+#include <cstdio>
+
+namespace {
+namespace fs = std::filesystem;
+using tools::filesystem::monitoring;
+
+std::size_t sink{};
+
+template <typename Function>
+void measure(const char* name, std::size_t bytes, Function&& run) {
+    double best{std::numeric_limits<double>::max()};
+    for (int round{}; round < 5; ++round) {
+        auto start{std::chrono::steady_clock::now()};
+        run();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    if (bytes) {
+        std::printf("  %-40s %10.3f ms %10.1f MB/s\n", name, best * 1e3, static_cast<double>(bytes) / best / 1e6);
+    } else {
+        std::printf("  %-40s %10.3f ms\n", name, best * 1e3);
+    }
+}
+
+void write_file(const fs::path& path, std::size_t size) {
+    std::string data(size, '\0');
+    for (std::size_t i{}; i < size; ++i)
+        data[i] = static_cast<char>('a' + i % 26);
+    std::ofstream(path, std::ios::binary).write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+// Touches every byte, so a mapping is paged in like a read buffer is filled
+void consume(std::string_view data) {
+    sink += tools::simd::count_byte(data.data(), data.size(), 'z');
+}
+
+std::string read_stream(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// user-051: zero-copy read_file
+void read_file_cases(const fs::path& dir) {
+    std::printf("read_file\n");
+    constexpr std::size_t large{64 * 1024 * 1024};
+    fs::path big{dir / "large.bin"};
+    write_file(big, large);
+
+    std::vector<fs::path> small;
+    for (int i{}; i < 1000; ++i) {
+        small.push_back(dir / ("small" + std::to_string(i) + ".txt"));
+        write_file(small.back(), 4096);
+    }
+
+    monitoring files;
+    using mode = monitoring::read_mode;
+    measure("ifstream, 64 MiB", large, [&] { consume(read_stream(big)); });
+    measure("read_file read, 64 MiB", large, [&] { consume(files.read_file(big, mode::read).view()); });
+    measure("read_file map, 64 MiB", large, [&] { consume(files.read_file(big, mode::map).view()); });
+    measure("ifstream, 1000 x 4 KiB", small.size() * 4096, [&] {
+        for (const fs::path& path : small)
+            consume(read_stream(path));
+    });
+    measure("read_file, 1000 x 4 KiB", small.size() * 4096, [&] {
+        for (const fs::path& path : small)
+            consume(files.read_file(path).view());
+    });
+}
+
+// user-053: non-copying file_t accessors and moves
+void file_cases(const fs::path& dir) {
+    std::printf("file_t, 64 MiB text\n");
+    constexpr std::size_t size{64 * 1024 * 1024};
+    std::string text(size, 'x');
+    tools::filesystem::file_t file(dir / "text.txt", std::string(text));
+
+    measure("std::string copy", 0, [&] {
+        std::string copy{text};
+        consume(std::string_view(copy).substr(0, 4096));
+    });
+    measure("file_t copy", 0, [&] {
+        tools::filesystem::file_t copy{file};
+        consume(copy.view().substr(0, 4096));
+    });
+    measure("get_text", 0, [&] { consume(std::string_view(file.get_text()).substr(0, 4096)); });
+    measure("view", 0, [&] { consume(file.view().substr(0, 4096)); });
+    measure("set_text(move) + take_text", 0, [&] {
+        file.set_text(std::move(text));
+        text = file.take_text();
+        consume(std::string_view(text).substr(0, 4096));
+    });
+}
+
+#if defined(__linux__)
+// user-057: batched reads through async_io
+void async_io_cases(const fs::path& dir) {
+    using tools::filesystem::async_io;
+    constexpr std::size_t size{64 * 1024 * 1024};
+    constexpr std::size_t block{4096};
+    constexpr std::size_t depth{256};
+    std::printf("async_io, 16384 random 4 KiB reads\n");
+
+    fs::path path{dir / "async.bin"};
+    write_file(path, size);
+    tools::filesystem::descriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+
+    std::mt19937_64 engine(57);
+    std::vector<std::uint64_t> offsets(16384);
+    for (std::uint64_t& offset : offsets)
+        offset = engine() % (size / block) * block;
+    std::vector<char> buffers(depth * block);
+    std::size_t bytes{offsets.size() * block};
+
+    std::ifstream stream(path, std::ios::binary);
+    measure("ifstream seekg + read", bytes, [&] {
+        for (std::uint64_t offset : offsets) {
+            stream.seekg(static_cast<std::streamoff>(offset));
+            stream.read(buffers.data(), block);
+            sink += static_cast<std::size_t>(stream.gcount());
+        }
+    });
+    measure("pread, one at a time", bytes, [&] {
+        for (std::uint64_t offset : offsets)
+            sink += static_cast<std::size_t>(::pread(fd.get(), buffers.data(), block, static_cast<off_t>(offset)));
+    });
+
+    auto batches{[&](async_io& io) {
+        std::vector<async_io::completion> done;
+        for (std::size_t i{}; i < offsets.size(); i += depth) {
+            for (std::size_t j{}; j < depth; ++j)
+                io.read(fd.get(), buffers.data() + j * block, block, offsets[i + j], j);
+            done.clear();
+            io.wait(done, depth);
+            for (const async_io::completion& item : done)
+                sink += static_cast<std::size_t>(item.result);
+        }
+    }};
+
+    async_io ring;
+    if (ring.get_backend() == async_io::backend::io_uring)
+        measure("io_uring, 256 in flight", bytes, [&] { batches(ring); });
+    async_io pool(4096, true);
+    measure("thread pool, 256 in flight", bytes, [&] { batches(pool); });
+}
+#endif
+
+// user-060: atomic replacement at each durability level
+void atomic_file_cases(const fs::path& dir) {
+    using tools::filesystem::durability;
+    std::printf("atomic_file, 32 files of 4 KiB replaced\n");
+
+    std::vector<fs::path> paths;
+    for (int i{}; i < 32; ++i) {
+        paths.push_back(dir / ("config" + std::to_string(i) + ".json"));
+        write_file(paths.back(), 4096);
+    }
+    std::string text(4096, 'r');
+    std::size_t bytes{paths.size() * text.size()};
+
+    measure("ofstream overwrite", bytes, [&] {
+        for (const fs::path& path : paths)
+            std::ofstream(path, std::ios::binary | std::ios::trunc) << text;
+    });
+
+    const std::pair<const char*, durability> levels[]{
+        { "atomic_file, none", durability::none },
+        { "atomic_file, data", durability::data },
+        { "atomic_file, full", durability::full },
+    };
+    for (const auto& [name, level] : levels) {
+        measure(name, bytes, [&, level = level] {
+            for (const fs::path& path : paths) {
+                tools::filesystem::atomic_file file(path);
+                file.write(text);
+                file.commit(level);
+            }
+        });
+    }
+
+    measure("atomic_batch, full", bytes, [&] {
+        tools::filesystem::atomic_batch batch(durability::full);
+        for (const fs::path& path : paths)
+            batch.stage(path, text);
+        batch.commit();
+    });
+}
+
+// user-061: parallel directory walk
+void walk_cases(const fs::path& dir) {
+    std::printf("walk, 420 directories and 10000 files\n");
+    fs::path root{dir / "tree"};
+    for (int i{}; i < 20; ++i) {
+        for (int j{}; j < 20; ++j) {
+            fs::path leaf{root / std::to_string(i) / std::to_string(j)};
+            fs::create_directories(leaf);
+            for (int k{}; k < 25; ++k)
+                std::ofstream(leaf / (std::to_string(k) + ".txt"));
+        }
+    }
+
+    measure("recursive_directory_iterator", 0, [&] {
+        for (const fs::directory_entry& entry : fs::recursive_directory_iterator(root))
+            sink += entry.is_regular_file();
+    });
+
+    tools::filesystem::walk_options single;
+    single.threads = 1;
+    measure("walk, 1 thread", 0, [&] { sink += tools::filesystem::walk(root, single).size(); });
+    measure("walk, all cores", 0, [&] { sink += tools::filesystem::walk(root).size(); });
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    fs::path dir{(argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path()) / "tools_benchmarks"};
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    read_file_cases(dir);
+    file_cases(dir);
+#if defined(__linux__)
+    async_io_cases(dir);
+#endif
+    atomic_file_cases(dir);
+    walk_cases(dir);
+
+    fs::remove_all(dir);
+    std::printf("checksum %zu\n", sink);
+    return 0;
+}
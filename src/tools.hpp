@@ -14,11 +14,57 @@
 #include <stdexcept>
 #include <fstream>
 #include <cstring>
+#include <cerrno>
 #include <string>
 #include <chrono>
 #include <random>
 #include <limits>
+#include <iterator>
+#include <condition_variable>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+#include <system_error>
+#include <memory>
+#include <utility>
+#include <span>
 #include <map>
+#include <set>
+#include <list>
+#include <unordered_map>
+#include <array>
+#include <tuple>
+#include <bit>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <dirent.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <linux/io_uring.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#if __has_include(<sys/fanotify.h>)
+#include <sys/fanotify.h>
+#endif
+#endif
 
 namespace fs = std::filesystem;
 
@@ -196,251 +242,7025 @@ private:
 };
 } // namespace time
 
-namespace filesystem {
-class file_t {
+namespace thread {
+/*
+    Work-stealing thread pool. Every worker owns a deque: tasks submitted
+    from a worker go to the back of its own deque and are taken LIFO, idle
+    workers steal from the front of the others. Tasks submitted from
+    outside are spread round-robin. The first exception thrown by a task
+    is kept and rethrown from wait().
+*/
+class pool {
 private:
-    using size_type        = std::size_t;
-    using path_reference   = const fs::path&;
-    using string_reference = const std::string&;
+    using size_type = std::size_t;
+    using task_type = std::function<void()>;
 
 public:
-    file_t() :
-        path_(fs::current_path() / "temporary_file.txt")
-    {}
+    pool() : pool(std::max<size_type>(1, std::thread::hardware_concurrency())) {}
 
-    explicit file_t(path_reference path) : file_t() {
-        set_path(path);
-    }
+    explicit pool(size_type threads) {
+        if (!threads)
+            throw std::invalid_argument("Incorrect argument");
 
-    explicit file_t(string_reference text) : file_t() {
-        set_text(text);
-    }
+        queues_.reserve(threads);
+        for (size_type i{}; i < threads; ++i)
+            queues_.push_back(std::make_unique<queue>());
 
-    explicit file_t(const char* text, size_type size) : file_t() {
-        set_text(text, size);
+        workers_.reserve(threads);
+        for (size_type i{}; i < threads; ++i)
+            workers_.emplace_back([this, i] { run(i); });
     }
 
-    explicit file_t(path_reference path, string_reference text) : file_t() {
-        set_path(path);
-        set_text(text);
-    }
+    pool(const pool&) = delete;
 
-    explicit file_t(path_reference path, const char* text, size_type size) : file_t() {
-        set_path(path);
-        set_text(text, size);
+    ~pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        task_cv_.notify_all();
+        for (auto& worker : workers_)
+            worker.join();
     }
 
-    explicit file_t(path_reference path, const char* text) = delete;
-
-    ~file_t() = default;
+public:
+    pool& operator=(const pool&) = delete;
 
 public:
-    void set_path(path_reference path) {
-        fs::path tmp_path{path};
-        tmp_path = tmp_path.remove_filename();
-        if (fs::exists(tmp_path)) {
-            path_ = path;
-            if (fs::is_directory(path))
-                path_ /= "temporary_file.txt";
+    template <typename Function>
+    void submit(Function&& task) {
+        pending_.fetch_add(1, std::memory_order_relaxed);
+
+        size_type index{current_ == this ? current_index_ :
+                        next_.fetch_add(1, std::memory_order_relaxed) % queues_.size()};
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            queues_[index]->tasks.emplace_back(std::forward<Function>(task));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++queued_;
         }
+        task_cv_.notify_one();
     }
 
-    void set_path(string_reference path) {
-        set_path(fs::path(path));
+    void wait() {
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            idle_cv_.wait(lock, [this] { return !pending_.load(std::memory_order_acquire); });
+            error = std::exchange(error_, nullptr);
+        }
+        if (error)
+            std::rethrow_exception(error);
     }
 
-    void set_filename(string_reference name) {
-        path_.replace_filename(fs::path(name));
+    size_type size() const noexcept { return workers_.size(); }
+
+private:
+    struct queue {
+        std::mutex mutex;
+        std::deque<task_type> tasks;
+    };
+
+private:
+    bool take(size_type index, task_type& task) {
+        {
+            queue& own{*queues_[index]};
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+
+        for (size_type i{1}; i < queues_.size(); ++i) {
+            queue& victim{*queues_[(index + i) % queues_.size()]};
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+
+        return false;
     }
 
-    void set_text(string_reference text) {
-        text_ = text;
-        size_ = text.size();
+    void run(size_type index) {
+        current_ = this;
+        current_index_ = index;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                task_cv_.wait(lock, [this] { return stop_ || queued_; });
+                if (!queued_)
+                    return;
+                --queued_;
+            }
+
+            task_type task;
+            while (!take(index, task))
+                std::this_thread::yield();
+
+            try {
+                task();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_)
+                    error_ = std::current_exception();
+            }
+            task = nullptr;
+
+            if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                idle_cv_.notify_all();
+            }
+        }
     }
 
-    void set_text(const char* text, size_type size) {
-        set_text(std::string(text, size));
+private:
+    static inline thread_local pool* current_{};
+    static inline thread_local size_type current_index_{};
+
+    std::vector<std::unique_ptr<queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_type> pending_{};
+    std::atomic<size_type> next_{};
+    size_type queued_{};
+    bool stop_{};
+    std::exception_ptr error_;
+    std::mutex mutex_;
+    std::condition_variable task_cv_;
+    std::condition_variable idle_cv_;
+};
+} // namespace thread
+
+namespace simd {
+/*
+    Runtime CPU feature checks for the vectorized paths; every caller
+    keeps a portable fallback. Defining TOOLS_NO_SIMD reports no features,
+    so a build can be checked against the portable paths alone.
+*/
+inline bool has_sse42() noexcept {
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(TOOLS_NO_SIMD)
+    static const bool result{static_cast<bool>(__builtin_cpu_supports("sse4.2"))};
+    return result;
+#else
+    return false;
+#endif
+}
+
+inline bool has_avx2() noexcept {
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(TOOLS_NO_SIMD)
+    static const bool result{static_cast<bool>(__builtin_cpu_supports("avx2"))};
+    return result;
+#else
+    return false;
+#endif
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("avx2")))
+inline std::size_t count_byte_avx2(const char* data, std::size_t size, char byte) noexcept {
+    const __m256i needle{_mm256_set1_epi8(byte)};
+    std::size_t count{};
+    std::size_t i{};
+    for (; i + 32 <= size; i += 32) {
+        __m256i block{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i))};
+        count += static_cast<std::size_t>(__builtin_popcount(
+            static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)))));
     }
+    for (; i < size; ++i)
+        count += data[i] == byte;
+    return count;
+}
+#endif
 
-    void set_text(const char* text) = delete;
+inline std::size_t count_byte(const char* data, std::size_t size, char byte) noexcept {
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (has_avx2())
+        return count_byte_avx2(data, size, byte);
+#endif
+    return static_cast<std::size_t>(std::count(data, data + size, byte));
+}
+} // namespace simd
 
-public:
-    std::string get_text() const { return text_; }
+namespace hash {
+struct hash128 {
+    std::uint64_t low{};
+    std::uint64_t high{};
 
-    fs::path get_path_fs() const { return path_; }
+    bool operator==(const hash128&) const = default;
+};
 
-    std::string get_path() const { return path_.generic_string(); }
+namespace detail {
+inline constexpr std::uint64_t prime64_1{0x9E3779B185EBCA87ULL};
+inline constexpr std::uint64_t prime64_2{0xC2B2AE3D27D4EB4FULL};
+inline constexpr std::uint64_t prime64_3{0x165667B19E3779F9ULL};
+inline constexpr std::uint64_t prime64_4{0x85EBCA77C2B2AE63ULL};
+inline constexpr std::uint64_t prime64_5{0x27D4EB2F165667C5ULL};
+inline constexpr std::uint32_t prime32_1{0x9E3779B1U};
 
-    fs::path get_dir_fs() const { return path_.parent_path(); }
+inline std::uint64_t read64(const unsigned char* data) noexcept {
+    std::uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    if constexpr (std::endian::native == std::endian::big)
+        value = __builtin_bswap64(value);
+    return value;
+}
 
-    std::string get_dir() const { return path_.parent_path().generic_string(); }
+inline std::uint32_t read32(const unsigned char* data) noexcept {
+    std::uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    if constexpr (std::endian::native == std::endian::big)
+        value = __builtin_bswap32(value);
+    return value;
+}
 
-    std::string get_filename() const { return path_.filename().generic_string(); }
+/*
+    Low ^ high half of the 128-bit product
+*/
+inline std::uint64_t fold_multiply(std::uint64_t lhs, std::uint64_t rhs) noexcept {
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 uint128;
+    uint128 product{static_cast<uint128>(lhs) * rhs};
+    return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+#else
+    std::uint64_t low_low{(lhs & 0xFFFFFFFF) * (rhs & 0xFFFFFFFF)};
+    std::uint64_t high_low{(lhs >> 32) * (rhs & 0xFFFFFFFF)};
+    std::uint64_t low_high{(lhs & 0xFFFFFFFF) * (rhs >> 32)};
+    std::uint64_t high_high{(lhs >> 32) * (rhs >> 32)};
+    std::uint64_t cross{(low_low >> 32) + (high_low & 0xFFFFFFFF) + low_high};
+    std::uint64_t high{high_high + (high_low >> 32) + (cross >> 32)};
+    std::uint64_t low{(cross << 32) | (low_low & 0xFFFFFFFF)};
+    return low ^ high;
+#endif
+}
+
+inline std::uint64_t avalanche(std::uint64_t hash) noexcept {
+    hash ^= hash >> 37;
+    hash *= 0x165667919E3779F9ULL;
+    return hash ^ (hash >> 32);
+}
+} // namespace detail
+
+/*
+    Incremental XXH64, bit-compatible with the reference implementation
+*/
+class xxh64 {
+private:
+    using size_type = std::size_t;
 
 public:
-    char& operator[](int index) {
-        return text_[index];
+    explicit xxh64(std::uint64_t seed = 0) noexcept : seed_(seed) {
+        reset();
     }
 
-    char operator[](int index) const {
-        return text_[index];
+public:
+    static std::uint64_t compute(const void* data, size_type size, std::uint64_t seed = 0) noexcept {
+        xxh64 state(seed);
+        state.update(data, size);
+        return state.digest();
+    }
+
+    static std::uint64_t compute(std::string_view text, std::uint64_t seed = 0) noexcept {
+        return compute(text.data(), text.size(), seed);
     }
 
 public:
-    std::size_t size() const noexcept { return size_; }
+    void reset() noexcept {
+        lanes_[0] = seed_ + detail::prime64_1 + detail::prime64_2;
+        lanes_[1] = seed_ + detail::prime64_2;
+        lanes_[2] = seed_;
+        lanes_[3] = seed_ - detail::prime64_1;
+        total_ = 0;
+        buffered_ = 0;
+    }
 
-    bool empty() const noexcept { return !size_; }
+    void update(const void* data, size_type size) noexcept {
+        const auto* input{static_cast<const unsigned char*>(data)};
+        total_ += size;
 
-    bool exists() const noexcept {
-        return fs::exists(path_) && !fs::is_directory(path_);
+        if (buffered_) {
+            size_type take{std::min(size, sizeof(buffer_) - buffered_)};
+            std::memcpy(buffer_ + buffered_, input, take);
+            buffered_ += take;
+            input += take;
+            size -= take;
+            if (buffered_ < sizeof(buffer_))
+                return;
+            consume(buffer_);
+            buffered_ = 0;
+        }
+
+        for (; size >= sizeof(buffer_); input += sizeof(buffer_), size -= sizeof(buffer_))
+            consume(input);
+
+        if (size) {
+            std::memcpy(buffer_, input, size);
+            buffered_ = size;
+        }
+    }
+
+    void update(std::string_view text) noexcept { update(text.data(), text.size()); }
+
+    std::uint64_t digest() const noexcept {
+        std::uint64_t hash;
+        if (total_ >= sizeof(buffer_)) {
+            hash = std::rotl(lanes_[0], 1) + std::rotl(lanes_[1], 7) + std::rotl(lanes_[2], 12) + std::rotl(lanes_[3], 18);
+            for (std::uint64_t lane : lanes_) {
+                hash ^= round(0, lane);
+                hash = hash * detail::prime64_1 + detail::prime64_4;
+            }
+        } else {
+            hash = seed_ + detail::prime64_5;
+        }
+        hash += total_;
+
+        const unsigned char* ptr{buffer_};
+        const unsigned char* end{buffer_ + buffered_};
+        for (; ptr + 8 <= end; ptr += 8) {
+            hash ^= round(0, detail::read64(ptr));
+            hash = std::rotl(hash, 27) * detail::prime64_1 + detail::prime64_4;
+        }
+        if (ptr + 4 <= end) {
+            hash ^= detail::read32(ptr) * detail::prime64_1;
+            hash = std::rotl(hash, 23) * detail::prime64_2 + detail::prime64_3;
+            ptr += 4;
+        }
+        for (; ptr < end; ++ptr) {
+            hash ^= *ptr * detail::prime64_5;
+            hash = std::rotl(hash, 11) * detail::prime64_1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= detail::prime64_2;
+        hash ^= hash >> 29;
+        hash *= detail::prime64_3;
+        return hash ^ (hash >> 32);
     }
 
 private:
-    std::size_t size_{};
-    std::string text_;
-    fs::path path_;
+    static std::uint64_t round(std::uint64_t lane, std::uint64_t input) noexcept {
+        lane += input * detail::prime64_2;
+        return std::rotl(lane, 31) * detail::prime64_1;
+    }
+
+    void consume(const unsigned char* input) noexcept {
+        for (size_type i{}; i < 4; ++i)
+            lanes_[i] = round(lanes_[i], detail::read64(input + i * 8));
+    }
+
+private:
+    std::uint64_t seed_;
+    std::uint64_t lanes_[4]{};
+    std::uint64_t total_{};
+    unsigned char buffer_[32]{};
+    size_type buffered_{};
 };
 
-class monitoring {
+/*
+    XXH3-style 64/128-bit hash: eight 64-bit lanes take a 64 byte stripe
+    at a time with a 32x32 multiply-accumulate, scrambled every sixteen
+    stripes. The stripe loop runs on AVX2 when the CPU has it. Same
+    construction as XXH3, but the secret is derived from the seed here,
+    so digests are not interchangeable with the reference library.
+*/
+class fast_hash {
 private:
     using size_type = std::size_t;
-    using mod       = console::ansi::mods;
-    using color     = console::ansi::colors;
-    using path_reference   = const fs::path&;
-    using string_reference = const std::string&;
-
-public:
-    monitoring() = default;
-    ~monitoring() = default;
 
-public:
-    file_t read_file(path_reference path) const {
-        if (!fs::exists(path) || fs::is_directory(path))
-            return file_t();
+    static constexpr size_type stripe_size{64};
+    static constexpr size_type block_stripes{16};
+    static constexpr size_type secret_size{192};
 
-        std::ifstream file_stream(path, std::ios::binary | std::ios::in);
-        std::unique_ptr<char[]> buffer;
-        std::size_t file_size{};
+    using accumulate_function = void (*)(std::uint64_t*, const unsigned char*, size_type, size_type&, const unsigned char*);
 
-        if (file_stream.is_open()) {
-            file_stream.seekg(0, std::ios::end);
-            file_size = file_stream.tellg();
-            file_stream.seekg(0, std::ios::beg);
-            buffer = std::make_unique<char[]>(file_size);
-            file_stream.read(buffer.get(), file_size);
-        } else {
-            std::string error_text{"Error: Cannot open file: "};
-            std::string filename{path.filename().generic_string()};
-            throw std::ios_base::failure(error_text + filename);
+public:
+    explicit fast_hash(std::uint64_t seed = 0) noexcept {
+        std::uint64_t state{seed ^ 0x6A09E667F3BCC909ULL};
+        for (size_type i{}; i < secret_size; i += 8) {
+            std::uint64_t word{state += 0x9E3779B97F4A7C15ULL};
+            word = (word ^ (word >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            word = (word ^ (word >> 27)) * 0x94D049BB133111EBULL;
+            word ^= word >> 31;
+            if constexpr (std::endian::native == std::endian::big)
+                word = __builtin_bswap64(word);
+            std::memcpy(secret_ + i, &word, sizeof(word));
         }
+        reset();
+    }
 
-        return file_t(path, buffer.get(), file_size);
+public:
+    static hash128 compute(const void* data, size_type size, std::uint64_t seed = 0) noexcept {
+        fast_hash state(seed);
+        state.update(data, size);
+        return state.digest();
     }
 
-    file_t read_file(string_reference path) const {
-        return read_file(fs::path(path));
+    static hash128 compute(std::string_view text, std::uint64_t seed = 0) noexcept {
+        return compute(text.data(), text.size(), seed);
     }
 
-    void read_file(file_t& file) const {
-        file = read_file(file.get_path_fs());
+public:
+    void reset() noexcept {
+        static constexpr std::uint64_t initial[8]{
+            detail::prime32_1, detail::prime64_1, detail::prime64_2, detail::prime64_3,
+            detail::prime64_4, 0x85EBCA77U, detail::prime64_5, 0xC2B2AE3DU
+        };
+        std::memcpy(acc_, initial, sizeof(acc_));
+        total_ = 0;
+        buffered_ = 0;
+        stripe_ = 0;
     }
 
-    void write_file(path_reference path, std::string_view text) const {
-        if (!fs::exists(path) || fs::is_directory(path))
-            return;
+    void update(const void* data, size_type size) noexcept {
+        const auto* input{static_cast<const unsigned char*>(data)};
+        total_ += size;
 
-        std::ofstream file_stream(path, std::ios::app);
+        if (buffered_) {
+            size_type take{std::min(size, stripe_size - buffered_)};
+            std::memcpy(buffer_ + buffered_, input, take);
+            buffered_ += take;
+            input += take;
+            size -= take;
+            if (buffered_ < stripe_size)
+                return;
+            accumulate()(acc_, buffer_, 1, stripe_, secret_);
+            buffered_ = 0;
+        }
 
-        if (file_stream.is_open()) {
-            file_stream << text;
-        } else {
-            std::string error_text{"Error: Cannot open file: "};
-            std::string filename{path.filename().generic_string()};
-            throw std::ios_base::failure(error_text + filename);
+        if (size >= stripe_size) {
+            size_type stripes{size / stripe_size};
+            accumulate()(acc_, input, stripes, stripe_, secret_);
+            input += stripes * stripe_size;
+            size -= stripes * stripe_size;
+        }
+
+        if (size) {
+            std::memcpy(buffer_, input, size);
+            buffered_ = size;
         }
     }
 
-    void create_file(const file_t& file) const {
-        fs::path path(file.get_path_fs());
-        std::ofstream file_stream(path, std::ios::out);
+    void update(std::string_view text) noexcept { update(text.data(), text.size()); }
 
-        if (file_stream.is_open()) {
-            file_stream << file.get_text();
-        } else {
-            std::string error_text{"Error: Cannot create file: "};
-            std::string filename{path.filename().generic_string()};
-            throw std::ios_base::failure(error_text + filename);
+    hash128 digest() const noexcept {
+        std::uint64_t acc[8];
+        std::memcpy(acc, acc_, sizeof(acc));
+        if (buffered_) {
+            unsigned char last[stripe_size]{};
+            std::memcpy(last, buffer_, buffered_);
+            accumulate_lanes(acc, last, secret_ + secret_size - stripe_size - 7);
+        }
+
+        std::uint64_t low{total_ * detail::prime64_1};
+        std::uint64_t high{~(total_ * detail::prime64_2)};
+        for (size_type i{}; i < 4; ++i) {
+            low += detail::fold_multiply(acc[2 * i] ^ detail::read64(secret_ + 11 + 16 * i),
+                                         acc[2 * i + 1] ^ detail::read64(secret_ + 19 + 16 * i));
+            high += detail::fold_multiply(acc[2 * i] ^ detail::read64(secret_ + 117 + 16 * i),
+                                          acc[2 * i + 1] ^ detail::read64(secret_ + 125 + 16 * i));
         }
+        return { detail::avalanche(low), detail::avalanche(high) };
     }
 
-    void create_file(path_reference path) const {
-        create_file(file_t(path));
+    std::uint64_t digest64() const noexcept { return digest().low; }
+
+private:
+    static void accumulate_lanes(std::uint64_t* acc, const unsigned char* input, const unsigned char* key) noexcept {
+        for (size_type i{}; i < 8; ++i) {
+            std::uint64_t value{detail::read64(input + i * 8)};
+            std::uint64_t keyed{value ^ detail::read64(key + i * 8)};
+            acc[i ^ 1] += value;
+            acc[i] += (keyed & 0xFFFFFFFFU) * (keyed >> 32);
+        }
     }
 
-    void create_file(string_reference path) const {
-        create_file(fs::path(path));
+    static void scramble_lanes(std::uint64_t* acc, const unsigned char* key) noexcept {
+        for (size_type i{}; i < 8; ++i) {
+            std::uint64_t lane{acc[i] ^ (acc[i] >> 47) ^ detail::read64(key + i * 8)};
+            acc[i] = lane * detail::prime32_1;
+        }
     }
 
-public:
-    std::string get_file_path() const {
-        fs::path path(fs::current_path());
-        while (true) {
-            std::string path_str{path.generic_string()};
+    static void accumulate_scalar(std::uint64_t* acc, const unsigned char* input, size_type stripes,
+                                  size_type& stripe, const unsigned char* secret) noexcept {
+        for (size_type i{}; i < stripes; ++i, input += stripe_size) {
+            accumulate_lanes(acc, input, secret + stripe * 8);
+            if (++stripe == block_stripes) {
+                scramble_lanes(acc, secret + secret_size - stripe_size);
+                stripe = 0;
+            }
+        }
+    }
 
-            print_filesystem(path_str);
-            print_menu(path_str);
+#if defined(__x86_64__) && defined(__GNUC__)
+    __attribute__((target("avx2")))
+    static void accumulate_avx2(std::uint64_t* acc, const unsigned char* input, size_type stripes,
+                                size_type& stripe, const unsigned char* secret) noexcept {
+        __m256i lanes[2]{ _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc)),
+                          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + 4)) };
+        const __m256i prime{_mm256_set1_epi32(static_cast<int>(detail::prime32_1))};
 
-            std::string opt;
-            std::cin >> opt;
-            if (opt == "0") {
-                break;
-            } else if (opt == "d") {
-                return path_str;
-            } else if (opt == "b") {
-                path = path.parent_path();
-            } else if (opt == "c") {
-                console::print_text("\nEnter filename: ", color::blue, "", " ");
-                std::string filename;
-                std::cin >> filename;
-                create_file(path / filename);
-                continue;
-            } else if (dirs_.find(opt) != dirs_.end()) {
-                auto [is_dir, name]{dirs_[opt]};
-                path /= name;
+        for (size_type i{}; i < stripes; ++i, input += stripe_size) {
+            const unsigned char* key{secret + stripe * 8};
+            for (size_type j{}; j < 2; ++j) {
+                __m256i value{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + j * 32))};
+                __m256i keyed{_mm256_xor_si256(value, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + j * 32)))};
+                __m256i product{_mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32))};
+                __m256i swapped{_mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2))};
+                lanes[j] = _mm256_add_epi64(lanes[j], _mm256_add_epi64(product, swapped));
+            }
 
-                if (!is_dir) {
-                    path_str = path.generic_string();
-                    if (!fs::exists(path_str)) {
-                        console::print_text("The file does not exist", color::red, "", " ");
-                        continue;
-                    }
-                    return path_str;
+            if (++stripe == block_stripes) {
+                const unsigned char* scramble_key{secret + secret_size - stripe_size};
+                for (size_type j{}; j < 2; ++j) {
+                    __m256i lane{_mm256_xor_si256(lanes[j], _mm256_srli_epi64(lanes[j], 47))};
+                    lane = _mm256_xor_si256(lane, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(scramble_key + j * 32)));
+                    __m256i low{_mm256_mul_epu32(lane, prime)};
+                    __m256i high{_mm256_mul_epu32(_mm256_srli_epi64(lane, 32), prime)};
+                    lanes[j] = _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
                 }
+                stripe = 0;
             }
         }
-        
-        return "";
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), lanes[0]);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + 4), lanes[1]);
+    }
+#endif
+
+    static accumulate_function accumulate() noexcept {
+#if defined(__x86_64__) && defined(__GNUC__)
+        if constexpr (std::endian::native == std::endian::little) {
+            static const accumulate_function function{simd::has_avx2() ? &accumulate_avx2 : &accumulate_scalar};
+            return function;
+        }
+#endif
+        return &accumulate_scalar;
     }
 
 private:
-    void print_filesystem(std::string_view path) const {
-        console::console_clear();
-        console::print_text("DIRS / FILES:\n", color::blue, mod::bold);
-        int num{1};
-        dirs_.clear();
-        for (const auto& entry : fs::directory_iterator(path)) {
-            if (entry.is_directory()) {
-                console::print_text(std::to_string(num) + ".", color::red, "", " ");
-                console::print_text("(Dir)", color::blue, mod::bold, "\t");
-                dirs_[std::to_string(num)] = { true, entry.path().filename().generic_string() };
-            } else {
-                console::print_text(std::to_string(num) + ".", color::red, "", " ");
-                console::print_text("(File)", color::green, mod::bold, "\t");
-                dirs_[std::to_string(num)] = { false, entry.path().filename().generic_string() };
+    std::uint64_t acc_[8]{};
+    unsigned char secret_[secret_size]{};
+    unsigned char buffer_[stripe_size]{};
+    size_type buffered_{};
+    size_type stripe_{};
+    std::uint64_t total_{};
+};
+
+/*
+    Incremental CRC32C (Castagnoli). Uses the SSE4.2 crc32 instruction over
+    three interleaved streams when available, slicing-by-8 tables
+    otherwise. combine() joins the checksums of adjacent pieces, which is
+    what the parallel compute() does.
+*/
+class crc32c {
+private:
+    using size_type  = std::size_t;
+    using table_type = std::array<std::array<std::uint32_t, 256>, 8>;
+
+    static constexpr std::uint32_t polynomial{0x82F63B78U};
+    static constexpr size_type lane_size{4096};
+
+public:
+    crc32c() = default;
+
+public:
+    static std::uint32_t compute(const void* data, size_type size, std::uint32_t crc = 0) noexcept {
+        return extend(crc, static_cast<const unsigned char*>(data), size);
+    }
+
+    static std::uint32_t compute(std::string_view text) noexcept {
+        return compute(text.data(), text.size());
+    }
+
+    /*
+        Checksums pieces of at least min_chunk bytes on up to threads
+        workers (0 for all cores); the result equals compute().
+    */
+    static std::uint32_t compute_parallel(const void* data, size_type size, size_type threads = 0,
+                                          size_type min_chunk = 4 * 1024 * 1024) {
+        if (!threads)
+            threads = std::max<size_type>(1, std::thread::hardware_concurrency());
+        size_type chunk{std::max(min_chunk, (size + threads - 1) / std::max<size_type>(threads, 1))};
+        if (threads < 2 || size <= chunk)
+            return compute(data, size);
+
+        const auto* input{static_cast<const unsigned char*>(data)};
+        std::vector<std::uint32_t> parts((size + chunk - 1) / chunk);
+        {
+            thread::pool workers(std::min(threads, parts.size()));
+            for (size_type i{}; i < parts.size(); ++i) {
+                workers.submit([&parts, input, size, chunk, i] {
+                    size_type offset{i * chunk};
+                    parts[i] = compute(input + offset, std::min(chunk, size - offset));
+                });
             }
-            console::print_text(entry.path().filename().generic_string());
-            num++;
+            workers.wait();
         }
+
+        std::uint32_t crc{parts[0]};
+        for (size_type i{1}; i < parts.size(); ++i)
+            crc = combine(crc, parts[i], std::min(chunk, size - i * chunk));
+        return crc;
+    }
+
+    /*
+        CRC of A followed by B, given crc(A), crc(B) and the size of B
+    */
+    static std::uint32_t combine(std::uint32_t first, std::uint32_t second, size_type second_size) noexcept {
+        return multiply(power(second_size), first) ^ second;
+    }
+
+public:
+    void update(const void* data, size_type size) noexcept {
+        crc_ = compute(data, size, crc_);
+    }
+
+    void update(std::string_view text) noexcept { update(text.data(), text.size()); }
+
+    std::uint32_t digest() const noexcept { return crc_; }
+
+    void reset() noexcept { crc_ = 0; }
+
+private:
+    static const table_type& tables() noexcept {
+        static const table_type result{[] {
+            table_type table{};
+            for (std::uint32_t i{}; i < 256; ++i) {
+                std::uint32_t crc{i};
+                for (int bit{}; bit < 8; ++bit)
+                    crc = (crc >> 1) ^ (polynomial & (0U - (crc & 1U)));
+                table[0][i] = crc;
+            }
+            for (std::uint32_t i{}; i < 256; ++i)
+                for (size_type slice{1}; slice < 8; ++slice)
+                    table[slice][i] = (table[slice - 1][i] >> 8) ^ table[0][table[slice - 1][i] & 0xFF];
+            return table;
+        }()};
+        return result;
+    }
+
+    static std::uint32_t extend_table(std::uint32_t crc, const unsigned char* input, size_type size) noexcept {
+        const table_type& table{tables()};
+        std::uint32_t state{~crc};
+        for (; size >= 8; input += 8, size -= 8) {
+            std::uint32_t low{detail::read32(input) ^ state};
+            std::uint32_t high{detail::read32(input + 4)};
+            state = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^
+                    table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+                    table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^
+                    table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+        }
+        for (; size; ++input, --size)
+            state = (state >> 8) ^ table[0][(state ^ *input) & 0xFF];
+        return ~state;
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    __attribute__((target("sse4.2")))
+    static std::uint32_t extend_sse42(std::uint32_t crc, const unsigned char* input, size_type size) noexcept {
+        static const std::uint32_t lane_shift{power(lane_size)};
+
+        std::uint64_t state{~crc};
+        while (size >= 3 * lane_size) {
+            std::uint64_t second{0xFFFFFFFFU};
+            std::uint64_t third{0xFFFFFFFFU};
+            for (size_type i{}; i < lane_size; i += 8) {
+                std::uint64_t a, b, c;
+                std::memcpy(&a, input + i, 8);
+                std::memcpy(&b, input + lane_size + i, 8);
+                std::memcpy(&c, input + 2 * lane_size + i, 8);
+                state = _mm_crc32_u64(state, a);
+                second = _mm_crc32_u64(second, b);
+                third = _mm_crc32_u64(third, c);
+            }
+            std::uint32_t merged{multiply(lane_shift, ~static_cast<std::uint32_t>(state)) ^ ~static_cast<std::uint32_t>(second)};
+            merged = multiply(lane_shift, merged) ^ ~static_cast<std::uint32_t>(third);
+            state = ~merged;
+            input += 3 * lane_size;
+            size -= 3 * lane_size;
+        }
+        for (; size >= 8; input += 8, size -= 8) {
+            std::uint64_t word;
+            std::memcpy(&word, input, 8);
+            state = _mm_crc32_u64(state, word);
+        }
+        for (; size; ++input, --size)
+            state = _mm_crc32_u8(static_cast<std::uint32_t>(state), *input);
+        return ~static_cast<std::uint32_t>(state);
+    }
+#endif
+
+    static std::uint32_t extend(std::uint32_t crc, const unsigned char* input, size_type size) noexcept {
+#if defined(__x86_64__) && defined(__GNUC__)
+        if (simd::has_sse42())
+            return extend_sse42(crc, input, size);
+#endif
+        return extend_table(crc, input, size);
+    }
+
+    /*
+        Product of two polynomials modulo the CRC polynomial
+    */
+    static std::uint32_t multiply(std::uint32_t lhs, std::uint32_t rhs) noexcept {
+        std::uint32_t mask{1U << 31};
+        std::uint32_t product{};
+        while (mask) {
+            if (lhs & mask)
+                product ^= rhs;
+            mask >>= 1;
+            rhs = (rhs >> 1) ^ (polynomial & (0U - (rhs & 1U)));
+        }
+        return product;
+    }
+
+    /*
+        x^(8 * size) modulo the CRC polynomial
+    */
+    static std::uint32_t power(size_type size) noexcept {
+        static const std::array<std::uint32_t, 64> squares{[] {
+            std::array<std::uint32_t, 64> table{};
+            std::uint32_t value{1U << 30};
+            for (std::uint32_t& item : table) {
+                item = value;
+                value = multiply(value, value);
+            }
+            return table;
+        }()};
+
+        std::uint32_t result{1U << 31};
+        for (size_type bit{3}; size; size >>= 1, ++bit) {
+            if (size & 1)
+                result = multiply(squares[bit & 63], result);
+        }
+        return result;
+    }
+
+private:
+    std::uint32_t crc_{};
+};
+
+/*
+    Content fingerprint that can be computed in parallel: inputs up to
+    leaf_size are hashed with fast_hash directly, larger ones as a list of
+    leaf_size leaves whose digests are hashed again together with the
+    total size. The result never depends on the thread count or on how an
+    incremental caller splits its updates.
+*/
+class tree_hash {
+private:
+    using size_type = std::size_t;
+
+public:
+    static constexpr size_type leaf_size{4 * 1024 * 1024};
+
+public:
+    tree_hash() = default;
+
+public:
+    static hash128 compute(const void* data, size_type size, size_type threads = 0) {
+        if (size <= leaf_size)
+            return fast_hash::compute(data, size);
+
+        if (!threads)
+            threads = std::max<size_type>(1, std::thread::hardware_concurrency());
+
+        const auto* input{static_cast<const unsigned char*>(data)};
+        std::vector<hash128> leaves((size + leaf_size - 1) / leaf_size);
+        auto hash_leaf{[&leaves, input, size](size_type i) {
+            size_type offset{i * leaf_size};
+            leaves[i] = fast_hash::compute(input + offset, std::min(leaf_size, size - offset));
+        }};
+
+        if (threads < 2) {
+            for (size_type i{}; i < leaves.size(); ++i)
+                hash_leaf(i);
+        } else {
+            thread::pool workers(std::min(threads, leaves.size()));
+            for (size_type i{}; i < leaves.size(); ++i)
+                workers.submit([&hash_leaf, i] { hash_leaf(i); });
+            workers.wait();
+        }
+        return root(leaves, size);
+    }
+
+    static hash128 compute(std::string_view text, size_type threads = 0) {
+        return compute(text.data(), text.size(), threads);
+    }
+
+public:
+    void update(const void* data, size_type size) {
+        const auto* input{static_cast<const unsigned char*>(data)};
+        while (size) {
+            if (leaf_bytes_ == leaf_size) {
+                leaves_.push_back(leaf_.digest());
+                leaf_.reset();
+                leaf_bytes_ = 0;
+            }
+            size_type take{std::min(size, leaf_size - leaf_bytes_)};
+            leaf_.update(input, take);
+            leaf_bytes_ += take;
+            total_ += take;
+            input += take;
+            size -= take;
+        }
+    }
+
+    void update(std::string_view text) { update(text.data(), text.size()); }
+
+    hash128 digest() const {
+        if (leaves_.empty())
+            return leaf_.digest();
+
+        std::vector<hash128> leaves(leaves_);
+        leaves.push_back(leaf_.digest());
+        return root(leaves, total_);
+    }
+
+private:
+    static hash128 root(const std::vector<hash128>& leaves, size_type total) noexcept {
+        fast_hash state;
+        for (const hash128& leaf : leaves) {
+            unsigned char bytes[16];
+            for (size_type i{}; i < 8; ++i) {
+                bytes[i] = static_cast<unsigned char>(leaf.low >> (8 * i));
+                bytes[8 + i] = static_cast<unsigned char>(leaf.high >> (8 * i));
+            }
+            state.update(bytes, sizeof(bytes));
+        }
+        unsigned char length[8];
+        for (size_type i{}; i < 8; ++i)
+            length[i] = static_cast<unsigned char>(static_cast<std::uint64_t>(total) >> (8 * i));
+        state.update(length, sizeof(length));
+        return state.digest();
+    }
+
+private:
+    fast_hash leaf_;
+    size_type leaf_bytes_{};
+    size_type total_{};
+    std::vector<hash128> leaves_;
+};
+} // namespace hash
+
+namespace unicode {
+namespace detail {
+/*
+    Length of the valid UTF-8 sequence at data (0 when invalid) and its
+    code point
+*/
+inline std::size_t decode_utf8(const unsigned char* data, std::size_t size, char32_t& code) noexcept {
+    unsigned char lead{data[0]};
+    if (lead < 0x80) {
+        code = lead;
+        return 1;
+    }
+
+    std::size_t length{};
+    unsigned char low{0x80};
+    unsigned char high{0xBF};
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        code = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        code = lead & 0x0F;
+        if (lead == 0xE0) low = 0xA0;
+        if (lead == 0xED) high = 0x9F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        code = lead & 0x07;
+        if (lead == 0xF0) low = 0x90;
+        if (lead == 0xF4) high = 0x8F;
+    } else {
+        return 0;
+    }
+
+    if (size < length || data[1] < low || data[1] > high)
+        return 0;
+    for (std::size_t i{1}; i < length; ++i) {
+        if ((data[i] & 0xC0) != 0x80)
+            return 0;
+        code = (code << 6) | (data[i] & 0x3F);
+    }
+    return length;
+}
+
+inline void encode_utf8(char32_t code, std::string& out) {
+    if (code < 0x80) {
+        out.push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+}
+
+inline bool validate_scalar(const unsigned char* data, std::size_t size) noexcept {
+    char32_t code{};
+    for (std::size_t i{}; i < size;) {
+        std::size_t length{decode_utf8(data + i, size - i, code)};
+        if (!length)
+            return false;
+        i += length;
+    }
+    return true;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/*
+    Keiser-Lemire lookup validation: three 16-entry tables indexed by the
+    nibbles of each byte and of the byte before it flag every invalid
+    two-byte pattern, a saturating subtract checks where the third and
+    fourth bytes of long sequences must be continuations.
+*/
+class utf8_checker {
+private:
+    static constexpr std::uint8_t too_short{1 << 0};
+    static constexpr std::uint8_t too_long{1 << 1};
+    static constexpr std::uint8_t overlong_3{1 << 2};
+    static constexpr std::uint8_t too_large{1 << 3};
+    static constexpr std::uint8_t surrogate{1 << 4};
+    static constexpr std::uint8_t overlong_2{1 << 5};
+    static constexpr std::uint8_t too_large_1000{1 << 6};
+    static constexpr std::uint8_t overlong_4{1 << 6};
+    static constexpr std::uint8_t two_continuations{1 << 7};
+    static constexpr std::uint8_t carry{too_short | too_long | two_continuations};
+
+    alignas(16) static constexpr std::uint8_t byte_1_high[16]{
+        too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+        two_continuations, two_continuations, two_continuations, two_continuations,
+        too_short | overlong_2,
+        too_short,
+        too_short | overlong_3 | surrogate,
+        too_short | too_large | too_large_1000 | overlong_4
+    };
+
+    alignas(16) static constexpr std::uint8_t byte_1_low[16]{
+        carry | overlong_3 | overlong_2 | overlong_4,
+        carry | overlong_2,
+        carry,
+        carry,
+        carry | too_large,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000 | surrogate,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000
+    };
+
+    alignas(16) static constexpr std::uint8_t byte_2_high[16]{
+        too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+        too_long | overlong_2 | two_continuations | overlong_3 | too_large_1000 | overlong_4,
+        too_long | overlong_2 | two_continuations | overlong_3 | too_large,
+        too_long | overlong_2 | two_continuations | surrogate | too_large,
+        too_long | overlong_2 | two_continuations | surrogate | too_large,
+        too_short, too_short, too_short, too_short
+    };
+
+    alignas(32) static constexpr std::uint8_t incomplete_limit[32]{
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+    };
+
+public:
+    __attribute__((target("avx2")))
+    void feed(__m256i input) noexcept {
+        if (!_mm256_movemask_epi8(input)) {
+            error_ = _mm256_or_si256(error_, incomplete_);
+            return;
+        }
+
+        __m256i joined{_mm256_permute2x128_si256(previous_, input, 0x21)};
+        __m256i prev1{_mm256_alignr_epi8(input, joined, 15)};
+        __m256i prev2{_mm256_alignr_epi8(input, joined, 14)};
+        __m256i prev3{_mm256_alignr_epi8(input, joined, 13)};
+
+        const __m256i nibble{_mm256_set1_epi8(0x0F)};
+        __m256i special{_mm256_and_si256(
+            _mm256_and_si256(lookup(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                             lookup(byte_1_low, _mm256_and_si256(prev1, nibble))),
+            lookup(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)))};
+
+        __m256i third{_mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)))};
+        __m256i fourth{_mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)))};
+        __m256i must_continue{_mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)))};
+
+        error_ = _mm256_or_si256(error_, _mm256_xor_si256(must_continue, special));
+        incomplete_ = _mm256_subs_epu8(input, _mm256_load_si256(reinterpret_cast<const __m256i*>(incomplete_limit)));
+        previous_ = input;
+    }
+
+    /*
+        True while nothing invalid was seen; with finished a sequence cut
+        off by the end of the input also counts as invalid
+    */
+    __attribute__((target("avx2")))
+    bool valid(bool finished) const noexcept {
+        __m256i error{finished ? _mm256_or_si256(error_, incomplete_) : error_};
+        return _mm256_testz_si256(error, error);
+    }
+
+private:
+    __attribute__((target("avx2")))
+    static __m256i lookup(const std::uint8_t* table, __m256i index) noexcept {
+        __m256i values{_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table)))};
+        return _mm256_shuffle_epi8(values, index);
+    }
+
+private:
+    __m256i error_{};
+    __m256i incomplete_{};
+    __m256i previous_{};
+};
+
+__attribute__((target("avx2")))
+inline bool validate_avx2(const char* data, std::size_t size) noexcept {
+    utf8_checker checker;
+    std::size_t i{};
+    for (; i + 32 <= size; i += 32)
+        checker.feed(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+
+    if (i < size) {
+        alignas(32) char tail[32]{};
+        std::memcpy(tail, data + i, size - i);
+        checker.feed(_mm256_load_si256(reinterpret_cast<const __m256i*>(tail)));
+    }
+    return checker.valid(true);
+}
+
+/*
+    Length of the leading run of whole 32 byte ASCII blocks
+*/
+__attribute__((target("avx2")))
+inline std::size_t ascii_prefix_avx2(const char* data, std::size_t size) noexcept {
+    std::size_t i{};
+    for (; i + 32 <= size; i += 32) {
+        if (_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i))))
+            break;
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline void widen_avx2(const char* data, std::size_t size, char16_t* out) noexcept {
+    for (std::size_t i{}; i < size; i += 16) {
+        __m128i block{_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i))};
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cvtepu8_epi16(block));
+    }
+}
+
+__attribute__((target("avx2")))
+inline void widen_avx2(const char* data, std::size_t size, char32_t* out) noexcept {
+    for (std::size_t i{}; i < size; i += 8) {
+        __m128i block{_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data + i))};
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cvtepu8_epi32(block));
+    }
+}
+
+/*
+    Narrows the leading run of 16 unit ASCII blocks and returns its length
+*/
+__attribute__((target("avx2")))
+inline std::size_t narrow_ascii_avx2(const char16_t* data, std::size_t size, std::string& out) {
+    const __m256i high_bits{_mm256_set1_epi16(static_cast<short>(0xFF80))};
+    std::size_t i{};
+    for (; i + 32 <= size; i += 32) {
+        __m256i first{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i))};
+        __m256i second{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 16))};
+        if (!_mm256_testz_si256(_mm256_or_si256(first, second), high_bits))
+            break;
+
+        __m256i packed{_mm256_permute4x64_epi64(_mm256_packus_epi16(first, second), 0xD8)};
+        std::size_t used{out.size()};
+        out.resize(used + 32);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.data() + used), packed);
+    }
+    return i;
+}
+#endif
+
+inline std::size_t ascii_prefix(const char* data, std::size_t size) noexcept {
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (simd::has_avx2())
+        return ascii_prefix_avx2(data, size);
+#endif
+    std::size_t i{};
+    while (i < size && !(static_cast<unsigned char>(data[i]) & 0x80))
+        ++i;
+    return i;
+}
+
+/*
+    Shared UTF-8 decoding loop: ASCII runs are widened in bulk, everything
+    else goes through decode_utf8 and put(code)
+*/
+template <typename Char, typename Put>
+void from_utf8(std::string_view text, std::basic_string<Char>& out, Put put) {
+    const auto* data{reinterpret_cast<const unsigned char*>(text.data())};
+    out.reserve(out.size() + text.size());
+    for (std::size_t i{}; i < text.size();) {
+        std::size_t run{ascii_prefix(text.data() + i, text.size() - i)};
+        if (run) {
+            std::size_t used{out.size()};
+            out.resize(used + run);
+#if defined(__x86_64__) && defined(__GNUC__)
+            if constexpr (!std::is_same_v<Char, char>) {
+                if (simd::has_avx2()) {
+                    widen_avx2(text.data() + i, run, out.data() + used);
+                    i += run;
+                    continue;
+                }
+            }
+#endif
+            std::copy(data + i, data + i + run, out.begin() + static_cast<std::ptrdiff_t>(used));
+            i += run;
+            continue;
+        }
+
+        for (std::size_t stop{std::min(text.size(), i + 32)}; i < stop;) {
+            char32_t code{};
+            std::size_t length{decode_utf8(data + i, text.size() - i, code)};
+            if (!length)
+                throw std::invalid_argument("Error: Invalid UTF-8 at offset " + std::to_string(i));
+            put(code, out);
+            i += length;
+        }
+    }
+}
+} // namespace detail
+
+/*
+    Validation runs the AVX2 Keiser-Lemire check when available and a
+    scalar decoder otherwise
+*/
+inline bool validate_utf8(std::string_view text) noexcept {
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (simd::has_avx2())
+        return detail::validate_avx2(text.data(), text.size());
+#endif
+    return detail::validate_scalar(reinterpret_cast<const unsigned char*>(text.data()), text.size());
+}
+
+/*
+    Validates input that arrives in pieces; a sequence split between two
+    pieces is completed from a small carry buffer
+*/
+class utf8_validator {
+private:
+    using size_type = std::size_t;
+
+public:
+    utf8_validator() = default;
+
+public:
+    bool update(std::string_view chunk) {
+        while (valid_ && pending_size_ && !chunk.empty()) {
+            pending_[pending_size_++] = chunk.front();
+            chunk.remove_prefix(1);
+            if (pending_size_ == pending_need_) {
+                valid_ = validate_utf8(std::string_view(pending_, pending_size_));
+                pending_size_ = 0;
+            }
+        }
+        if (!valid_ || chunk.empty())
+            return valid_;
+
+        size_type cut{chunk.size()};
+        size_type need{};
+        for (size_type back{1}; back <= std::min<size_type>(3, chunk.size()); ++back) {
+            auto byte{static_cast<unsigned char>(chunk[chunk.size() - back])};
+            if ((byte & 0xC0) == 0x80)
+                continue;
+            need = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : byte >= 0xC0 ? 2 : 1;
+            if (need > back)
+                cut = chunk.size() - back;
+            break;
+        }
+
+        valid_ = validate_utf8(chunk.substr(0, cut));
+        if (valid_ && cut < chunk.size()) {
+            pending_size_ = chunk.size() - cut;
+            pending_need_ = need;
+            std::memcpy(pending_, chunk.data() + cut, pending_size_);
+        }
+        return valid_;
+    }
+
+    /*
+        True when everything seen was valid and no sequence is left open
+    */
+    bool finish() const noexcept { return valid_ && !pending_size_; }
+
+    void reset() noexcept {
+        valid_ = true;
+        pending_size_ = 0;
+    }
+
+private:
+    bool valid_{true};
+    char pending_[4]{};
+    size_type pending_size_{};
+    size_type pending_need_{};
+};
+
+/*
+    Transcoders throw std::invalid_argument on malformed input. UTF-16 and
+    UTF-32 are in native byte order.
+*/
+inline std::u16string utf8_to_utf16(std::string_view text) {
+    std::u16string out;
+    detail::from_utf8(text, out, [](char32_t code, std::u16string& result) {
+        if (code < 0x10000) {
+            result.push_back(static_cast<char16_t>(code));
+        } else {
+            code -= 0x10000;
+            result.push_back(static_cast<char16_t>(0xD800 + (code >> 10)));
+            result.push_back(static_cast<char16_t>(0xDC00 + (code & 0x3FF)));
+        }
+    });
+    return out;
+}
+
+inline std::u32string utf8_to_utf32(std::string_view text) {
+    std::u32string out;
+    detail::from_utf8(text, out, [](char32_t code, std::u32string& result) { result.push_back(code); });
+    return out;
+}
+
+inline std::string utf8_to_latin1(std::string_view text) {
+    std::string out;
+    detail::from_utf8(text, out, [](char32_t code, std::string& result) {
+        if (code > 0xFF)
+            throw std::invalid_argument("Error: Code point is not representable in Latin-1");
+        result.push_back(static_cast<char>(code));
+    });
+    return out;
+}
+
+inline std::string latin1_to_utf8(std::string_view text) {
+    std::string out;
+    out.reserve(text.size());
+    for (std::size_t i{}; i < text.size();) {
+        std::size_t run{detail::ascii_prefix(text.data() + i, text.size() - i)};
+        out.append(text.data() + i, run);
+        i += run;
+        for (std::size_t stop{std::min(text.size(), i + 32)}; i < stop; ++i)
+            detail::encode_utf8(static_cast<unsigned char>(text[i]), out);
+    }
+    return out;
+}
+
+inline std::string utf16_to_utf8(std::u16string_view text) {
+    std::string out;
+    out.reserve(text.size());
+    for (std::size_t i{}; i < text.size();) {
+#if defined(__x86_64__) && defined(__GNUC__)
+        if (simd::has_avx2()) {
+            i += detail::narrow_ascii_avx2(text.data() + i, text.size() - i, out);
+        }
+#endif
+        for (std::size_t stop{std::min(text.size(), i + 32)}; i < stop; ++i) {
+            char32_t code{text[i]};
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                if (i + 1 == text.size() || text[i + 1] < 0xDC00 || text[i + 1] > 0xDFFF)
+                    throw std::invalid_argument("Error: Unpaired UTF-16 surrogate at " + std::to_string(i));
+                code = 0x10000 + ((code - 0xD800) << 10) + (text[i + 1] - 0xDC00);
+                ++i;
+            } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                throw std::invalid_argument("Error: Unpaired UTF-16 surrogate at " + std::to_string(i));
+            }
+            detail::encode_utf8(code, out);
+        }
+    }
+    return out;
+}
+
+inline std::string utf32_to_utf8(std::u32string_view text) {
+    std::string out;
+    out.reserve(text.size());
+    for (std::size_t i{}; i < text.size(); ++i) {
+        char32_t code{text[i]};
+        if (code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+            throw std::invalid_argument("Error: Invalid code point at " + std::to_string(i));
+        detail::encode_utf8(code, out);
+    }
+    return out;
+}
+} // namespace unicode
+
+namespace filesystem {
+/*
+    Owning POSIX file descriptor
+*/
+class descriptor {
+public:
+    descriptor() = default;
+
+    explicit descriptor(int fd) noexcept : fd_(fd) {}
+
+    descriptor(const descriptor&) = delete;
+
+    descriptor(descriptor&& other) noexcept :
+        fd_(std::exchange(other.fd_, -1))
+    {}
+
+    ~descriptor() {
+        close();
+    }
+
+public:
+    descriptor& operator=(const descriptor&) = delete;
+
+    descriptor& operator=(descriptor&& other) noexcept {
+        if (this != &other) {
+            close();
+            fd_ = std::exchange(other.fd_, -1);
+        }
+        return *this;
+    }
+
+    explicit operator bool() const noexcept { return fd_ != -1; }
+
+public:
+    int get() const noexcept { return fd_; }
+
+    int release() noexcept { return std::exchange(fd_, -1); }
+
+    void close() noexcept {
+        if (fd_ != -1)
+            ::close(std::exchange(fd_, -1));
+    }
+
+private:
+    int fd_{-1};
+};
+
+inline std::size_t read_full(int fd, char* data, std::size_t size, std::error_code& error) noexcept {
+    std::size_t done{};
+    while (done < size) {
+        ssize_t count{::read(fd, data + done, size - done)};
+        if (count == -1) {
+            if (errno == EINTR)
+                continue;
+            error = std::error_code(errno, std::system_category());
+            break;
+        }
+        if (count == 0)
+            break;
+        done += static_cast<std::size_t>(count);
+    }
+    return done;
+}
+
+inline std::size_t read_full(int fd, char* data, std::size_t size) {
+    std::error_code error;
+    std::size_t done{read_full(fd, data, size, error)};
+    if (error)
+        throw std::ios_base::failure("Error: Cannot read file");
+    return done;
+}
+
+inline std::size_t pread_full(int fd, char* data, std::size_t size, off_t offset, std::error_code& error) noexcept {
+    std::size_t done{};
+    while (done < size) {
+        ssize_t count{::pread(fd, data + done, size - done, offset + static_cast<off_t>(done))};
+        if (count == -1) {
+            if (errno == EINTR)
+                continue;
+            error = std::error_code(errno, std::system_category());
+            break;
+        }
+        if (count == 0)
+            break;
+        done += static_cast<std::size_t>(count);
+    }
+    return done;
+}
+
+inline std::size_t pread_full(int fd, char* data, std::size_t size, off_t offset) {
+    std::error_code error;
+    std::size_t done{pread_full(fd, data, size, offset, error)};
+    if (error)
+        throw std::ios_base::failure("Error: Cannot read file");
+    return done;
+}
+
+inline void write_full(int fd, std::string_view data, std::error_code& error) noexcept {
+    while (!data.empty()) {
+        ssize_t count{::write(fd, data.data(), data.size())};
+        if (count == -1) {
+            if (errno == EINTR)
+                continue;
+            error = std::error_code(errno, std::system_category());
+            return;
+        }
+        data.remove_prefix(static_cast<std::size_t>(count));
+    }
+}
+
+inline void write_full(int fd, std::string_view data) {
+    std::error_code error;
+    write_full(fd, data, error);
+    if (error)
+        throw std::ios_base::failure("Error: Cannot write file");
+}
+
+/*
+    Read-only memory mapping of a whole file
+*/
+class mapped_region {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+
+public:
+    enum class advice { normal, sequential, random, willneed, hugepage };
+
+public:
+    mapped_region() = default;
+
+    explicit mapped_region(path_reference path) {
+        descriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (!fd) {
+            std::string error_text{"Error: Cannot open file: "};
+            std::string filename{path.filename().generic_string()};
+            throw std::ios_base::failure(error_text + filename);
+        }
+
+        struct stat info{};
+        if (::fstat(fd.get(), &info) == -1)
+            throw std::ios_base::failure("Error: Cannot stat file");
+
+        map(fd.get(), static_cast<size_type>(info.st_size));
+    }
+
+    explicit mapped_region(int fd, size_type size) {
+        map(fd, size);
+    }
+
+    mapped_region(const mapped_region&) = delete;
+
+    mapped_region(mapped_region&& other) noexcept :
+        data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0))
+    {}
+
+    ~mapped_region() {
+        unmap();
+    }
+
+public:
+    mapped_region& operator=(const mapped_region&) = delete;
+
+    mapped_region& operator=(mapped_region&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+public:
+    const char* data() const noexcept { return data_; }
+
+    size_type size() const noexcept { return size_; }
+
+    bool empty() const noexcept { return !size_; }
+
+    std::string_view view() const noexcept { return { data_, size_ }; }
+
+    std::span<const char> span() const noexcept { return { data_, size_ }; }
+
+    bool advise(advice hint) const noexcept {
+        if (!data_)
+            return false;
+
+        int flag{MADV_NORMAL};
+        switch (hint) {
+            case advice::normal:     flag = MADV_NORMAL;     break;
+            case advice::sequential: flag = MADV_SEQUENTIAL; break;
+            case advice::random:     flag = MADV_RANDOM;     break;
+            case advice::willneed:   flag = MADV_WILLNEED;   break;
+            case advice::hugepage:
+#if defined(MADV_HUGEPAGE)
+                flag = MADV_HUGEPAGE;
+                break;
+#else
+                return false;
+#endif
+        }
+
+        return ::madvise(const_cast<char*>(data_), size_, flag) == 0;
+    }
+
+private:
+    void map(int fd, size_type size) {
+        if (!size)
+            return;
+
+        void* data{::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)};
+        if (data == MAP_FAILED)
+            throw std::ios_base::failure("Error: Cannot map file");
+
+        data_ = static_cast<const char*>(data);
+        size_ = size;
+    }
+
+    void unmap() noexcept {
+        if (data_)
+            ::munmap(const_cast<char*>(data_), size_);
+    }
+
+private:
+    const char* data_{};
+    size_type size_{};
+};
+
+/*
+    Immutable reference-counted buffer. Copies and slices share the storage,
+    the reference count is the atomic one of std::shared_ptr.
+    Mutation goes through mutable_data(), which copies unless the buffer
+    is the only owner of a string it created. A buffer that has handed out
+    a mutable pointer is no longer shared: copies and slices of it get
+    their own storage, so later writes through that pointer stay local.
+    Such a buffer is always the only owner of its string, so further
+    mutable_data() calls return at once.
+*/
+class shared_buffer {
+private:
+    using size_type = std::size_t;
+
+public:
+    static constexpr size_type npos{std::string_view::npos};
+
+public:
+    shared_buffer() = default;
+
+    explicit shared_buffer(std::string&& text) {
+        if (text.empty())
+            return;
+
+        auto owner{std::make_shared<std::string>(std::move(text))};
+        data_ = owner->data();
+        size_ = owner->size();
+        string_ = owner.get();
+        owner_ = std::move(owner);
+    }
+
+    explicit shared_buffer(mapped_region&& region) {
+        if (region.empty())
+            return;
+
+        auto owner{std::make_shared<const mapped_region>(std::move(region))};
+        data_ = owner->data();
+        size_ = owner->size();
+        region_ = owner.get();
+        owner_ = std::move(owner);
+    }
+
+    explicit shared_buffer(std::shared_ptr<const void> owner, const char* data, size_type size) noexcept :
+        owner_(std::move(owner)),
+        data_(data),
+        size_(size)
+    {}
+
+    shared_buffer(const shared_buffer& other) :
+        owner_(other.owner_),
+        string_(other.string_),
+        region_(other.region_),
+        data_(other.data_),
+        size_(other.size_)
+    {
+        if (other.leaked_)
+            *this = shared_buffer(std::string(other.view()));
+    }
+
+    shared_buffer(shared_buffer&& other) noexcept :
+        owner_(std::move(other.owner_)),
+        string_(std::exchange(other.string_, nullptr)),
+        region_(std::exchange(other.region_, nullptr)),
+        data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)),
+        leaked_(std::exchange(other.leaked_, false))
+    {}
+
+    ~shared_buffer() = default;
+
+public:
+    shared_buffer& operator=(const shared_buffer& other) {
+        if (this != &other)
+            *this = shared_buffer(other);
+        return *this;
+    }
+
+    shared_buffer& operator=(shared_buffer&& other) noexcept {
+        if (this != &other) {
+            owner_ = std::move(other.owner_);
+            string_ = std::exchange(other.string_, nullptr);
+            region_ = std::exchange(other.region_, nullptr);
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            leaked_ = std::exchange(other.leaked_, false);
+        }
+        return *this;
+    }
+
+public:
+    const char* data() const noexcept { return data_; }
+
+    size_type size() const noexcept { return size_; }
+
+    bool empty() const noexcept { return !size_; }
+
+    bool is_mapped() const noexcept { return region_; }
+
+    bool unique() const noexcept { return owner_.use_count() == 1; }
+
+    bool shareable() const noexcept { return !leaked_; }
+
+    std::string_view view() const noexcept { return { data_, size_ }; }
+
+    std::span<const char> span() const noexcept { return { data_, size_ }; }
+
+    bool advise(mapped_region::advice hint) const noexcept {
+        return region_ && region_->advise(hint);
+    }
+
+    shared_buffer slice(size_type pos, size_type count = npos) const {
+        if (pos > size_)
+            throw std::out_of_range("Error: Slice out of range");
+        if (leaked_)
+            return shared_buffer(std::string(view().substr(pos, count)));
+
+        shared_buffer buffer(*this);
+        buffer.data_ += pos;
+        buffer.size_ = std::min(count, size_ - pos);
+        return buffer;
+    }
+
+    char* mutable_data() {
+        if (leaked_)
+            return const_cast<char*>(data_);
+        if (!string_ || !unique())
+            *this = shared_buffer(std::string(view()));
+        leaked_ = !empty();
+        return const_cast<char*>(data_);
+    }
+
+    std::string take() {
+        std::string text;
+        if (string_ && unique() && data_ == string_->data() && size_ == string_->size()) {
+            text = std::move(*string_);
+        } else {
+            text.assign(data_, size_);
+        }
+        *this = shared_buffer();
+        return text;
+    }
+
+private:
+    std::shared_ptr<const void> owner_;
+    std::string* string_{};
+    const mapped_region* region_{};
+    const char* data_{};
+    size_type size_{};
+    bool leaked_{};
+};
+
+/*
+    Start offset of every line of a text, so line n and the line holding
+    a byte offset are found without rescanning. Newlines are located 32
+    bytes at a time with AVX2 (16 with SSE2), in parallel chunks for large
+    texts. save() and load() keep the index in a sidecar file next to the
+    source, trusted only while the source keeps its size, mtime and inode.
+*/
+class line_index {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+
+    static constexpr std::uint64_t magic{0x31584449454E494CULL};
+    static constexpr size_type parallel_threshold{8 * 1024 * 1024};
+
+    struct header {
+        std::uint64_t magic{};
+        std::uint64_t size{};
+        std::uint64_t inode{};
+        std::int64_t mtime_ns{};
+        std::uint64_t count{};
+    };
+
+public:
+    line_index() = default;
+
+    /*
+        threads = 0 uses every core once the text is large enough
+    */
+    explicit line_index(std::string_view text, size_type threads = 1) :
+        size_(text.size())
+    {
+        if (!threads)
+            threads = std::max<size_type>(1, std::thread::hardware_concurrency());
+
+        starts_.push_back(0);
+        if (threads < 2 || text.size() < parallel_threshold) {
+            collect(text.data(), 0, text.size(), starts_);
+        } else {
+            size_type chunk{(text.size() + threads - 1) / threads};
+            std::vector<std::vector<std::uint64_t>> parts(threads);
+            {
+                thread::pool workers(threads);
+                for (size_type i{}; i < threads; ++i) {
+                    workers.submit([&parts, text, chunk, i] {
+                        size_type begin{std::min(text.size(), i * chunk)};
+                        collect(text.data(), begin, std::min(text.size(), begin + chunk), parts[i]);
+                    });
+                }
+                workers.wait();
+            }
+
+            size_type total{1};
+            for (const std::vector<std::uint64_t>& part : parts)
+                total += part.size();
+            starts_.reserve(total + 1);
+            for (const std::vector<std::uint64_t>& part : parts)
+                starts_.insert(starts_.end(), part.begin(), part.end());
+        }
+
+        // The sentinel makes every line end one byte before the next start
+        if (!text.empty() && text.back() != '\n')
+            starts_.push_back(text.size() + 1);
+    }
+
+public:
+    size_type line_count() const noexcept { return starts_.empty() ? 0 : starts_.size() - 1; }
+
+    size_type text_size() const noexcept { return size_; }
+
+    /*
+        Byte range [first, second) of line n (0-based) without its newline
+    */
+    std::pair<size_type, size_type> bounds(size_type n) const {
+        if (n >= line_count())
+            throw std::out_of_range("Error: Line out of range");
+        return { static_cast<size_type>(starts_[n]), static_cast<size_type>(starts_[n + 1] - 1) };
+    }
+
+    size_type line_of_offset(size_type offset) const {
+        if (offset >= size_)
+            throw std::out_of_range("Error: Offset out of range");
+        auto it{std::upper_bound(starts_.begin(), starts_.end(), static_cast<std::uint64_t>(offset))};
+        return static_cast<size_type>(it - starts_.begin()) - 1;
+    }
+
+public:
+    static fs::path sidecar_path(path_reference source) {
+        fs::path result{source};
+        result += ".lines";
+        return result;
+    }
+
+    bool save(path_reference source) const {
+        struct stat info{};
+        if (::stat(source.c_str(), &info) == -1 || static_cast<size_type>(info.st_size) != size_)
+            return false;
+
+        header head{ magic, size_, static_cast<std::uint64_t>(info.st_ino), mtime_of(info), starts_.size() };
+        std::string name{sidecar_path(source).native() + ".XXXXXX"};
+        descriptor fd(::mkostemp(name.data(), O_CLOEXEC));
+        if (!fd)
+            return false;
+
+        std::error_code error;
+        write_full(fd.get(), std::string_view(reinterpret_cast<const char*>(&head), sizeof(head)), error);
+        if (!error) {
+            write_full(fd.get(), std::string_view(reinterpret_cast<const char*>(starts_.data()),
+                                                  starts_.size() * sizeof(std::uint64_t)), error);
+        }
+        fd.close();
+        if (error || ::rename(name.c_str(), sidecar_path(source).c_str()) == -1) {
+            ::unlink(name.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool load(path_reference source) {
+        struct stat info{};
+        descriptor fd(::open(sidecar_path(source).c_str(), O_RDONLY | O_CLOEXEC));
+        if (!fd || ::stat(source.c_str(), &info) == -1)
+            return false;
+
+        header head;
+        std::error_code error;
+        if (read_full(fd.get(), reinterpret_cast<char*>(&head), sizeof(head), error) != sizeof(head) || error)
+            return false;
+        if (head.magic != magic || head.size != static_cast<std::uint64_t>(info.st_size) ||
+            head.inode != static_cast<std::uint64_t>(info.st_ino) || head.mtime_ns != mtime_of(info) ||
+            head.count == 0 || head.count > head.size + 2)
+            return false;
+
+        std::vector<std::uint64_t> starts(static_cast<size_type>(head.count));
+        size_type bytes{starts.size() * sizeof(std::uint64_t)};
+        if (read_full(fd.get(), reinterpret_cast<char*>(starts.data()), bytes, error) != bytes || error)
+            return false;
+        if (starts.front() != 0 || starts.back() > head.size + 1 || !std::is_sorted(starts.begin(), starts.end()))
+            return false;
+
+        starts_ = std::move(starts);
+        size_ = static_cast<size_type>(head.size);
+        return true;
+    }
+
+private:
+    static std::int64_t mtime_of(const struct stat& info) noexcept {
+#if defined(__linux__)
+        return static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#else
+        return static_cast<std::int64_t>(info.st_mtime) * 1000000000;
+#endif
+    }
+
+    /*
+        Appends the offset after every newline in [begin, end)
+    */
+    static void collect(const char* data, size_type begin, size_type end, std::vector<std::uint64_t>& out) {
+#if defined(__x86_64__) && defined(__GNUC__)
+        if (simd::has_avx2()) {
+            collect_avx2(data, begin, end, out);
+            return;
+        }
+
+        for (; begin + 16 <= end; begin += 16) {
+            __m128i block{_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + begin))};
+            auto mask{static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))))};
+            for (; mask; mask &= mask - 1)
+                out.push_back(begin + static_cast<size_type>(__builtin_ctz(mask)) + 1);
+        }
+#endif
+        while (begin < end) {
+            const void* hit{std::memchr(data + begin, '\n', end - begin)};
+            if (!hit)
+                break;
+            begin = static_cast<size_type>(static_cast<const char*>(hit) - data) + 1;
+            out.push_back(begin);
+        }
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    __attribute__((target("avx2")))
+    static void collect_avx2(const char* data, size_type begin, size_type end, std::vector<std::uint64_t>& out) {
+        const __m256i newline{_mm256_set1_epi8('\n')};
+        for (; begin + 32 <= end; begin += 32) {
+            __m256i block{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + begin))};
+            auto mask{static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)))};
+            for (; mask; mask &= mask - 1)
+                out.push_back(begin + static_cast<size_type>(__builtin_ctz(mask)) + 1);
+        }
+        for (; begin < end; ++begin) {
+            if (data[begin] == '\n')
+                out.push_back(begin + 1);
+        }
+    }
+#endif
+
+private:
+    std::vector<std::uint64_t> starts_;
+    size_type size_{};
+};
+
+/*
+    Optional 32 byte prefix of a record file. It pins the byte order and
+    record size of the writer so a reader on another machine, or with a
+    changed struct, is refused instead of misreading the data.
+*/
+struct record_header {
+    static constexpr std::uint32_t signature{0x53434552};
+    static constexpr std::uint32_t byte_order{0x01020304};
+
+    std::uint32_t magic{signature};
+    std::uint32_t order{byte_order};
+    std::uint32_t record_size{};
+    std::uint32_t record_align{};
+    std::uint64_t reserved[2]{};
+};
+
+static_assert(sizeof(record_header) == 32);
+
+/*
+    Read-only sequence of T over bytes of any alignment; elements are
+    copied out with memcpy on access.
+*/
+template <typename T>
+class record_view {
+private:
+    using size_type = std::size_t;
+
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const T*;
+        using reference         = T;
+
+    public:
+        iterator() = default;
+
+        explicit iterator(const char* data) : data_(data) {}
+
+    public:
+        T operator*() const noexcept {
+            T value;
+            std::memcpy(&value, data_, sizeof(T));
+            return value;
+        }
+
+        iterator& operator++() noexcept {
+            data_ += sizeof(T);
+            return *this;
+        }
+
+        void operator++(int) noexcept { ++(*this); }
+
+        bool operator==(const iterator& other) const noexcept { return data_ == other.data_; }
+
+    private:
+        const char* data_{};
+    };
+
+public:
+    record_view() = default;
+
+    explicit record_view(const char* data, size_type count) :
+        data_(data),
+        count_(count)
+    {}
+
+public:
+    T operator[](size_type index) const noexcept {
+        T value;
+        std::memcpy(&value, data_ + index * sizeof(T), sizeof(T));
+        return value;
+    }
+
+    T at(size_type index) const {
+        if (index >= count_)
+            throw std::out_of_range("Error: Record out of range");
+        return (*this)[index];
+    }
+
+    size_type size() const noexcept { return count_; }
+
+    bool empty() const noexcept { return !count_; }
+
+    iterator begin() const noexcept { return iterator(data_); }
+
+    iterator end() const noexcept { return iterator(data_ + count_ * sizeof(T)); }
+
+private:
+    const char* data_{};
+    size_type count_{};
+};
+
+/*
+    Appends spans of records to a file, each span with one write call.
+    With a header the file starts with a record_header for T.
+*/
+template <typename T>
+class record_writer {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    explicit record_writer(path_reference path, bool header = true, bool append = false) :
+        fd_(::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644))
+    {
+        if (!fd_)
+            throw std::ios_base::failure("Error: Cannot open file: " + path.filename().generic_string());
+
+        struct stat info{};
+        if (header && (!append || (::fstat(fd_.get(), &info) == 0 && info.st_size == 0))) {
+            record_header head{};
+            head.record_size = sizeof(T);
+            head.record_align = alignof(T);
+            write_full(fd_.get(), std::string_view(reinterpret_cast<const char*>(&head), sizeof(head)));
+        }
+    }
+
+public:
+    void write(std::span<const T> records) {
+        write_full(fd_.get(), std::string_view(reinterpret_cast<const char*>(records.data()), records.size_bytes()));
+    }
+
+    void write(const T& record) {
+        write(std::span<const T>(&record, 1));
+    }
+
+    void close() noexcept { fd_.close(); }
+
+private:
+    descriptor fd_;
+};
+
+class file_t {
+private:
+    using size_type        = std::size_t;
+    using path_reference   = const fs::path&;
+    using string_reference = const std::string&;
+
+public:
+    file_t() :
+        path_(fs::current_path() / "temporary_file.txt")
+    {}
+
+    explicit file_t(path_reference path) : file_t() {
+        set_path(path);
+    }
+
+    explicit file_t(string_reference text) : file_t() {
+        set_text(text);
+    }
+
+    explicit file_t(const char* text, size_type size) : file_t() {
+        set_text(text, size);
+    }
+
+    explicit file_t(path_reference path, string_reference text) : file_t() {
+        set_path(path);
+        set_text(text);
+    }
+
+    explicit file_t(path_reference path, const char* text, size_type size) : file_t() {
+        set_path(path);
+        set_text(text, size);
+    }
+
+    explicit file_t(path_reference path, std::string&& text) : file_t() {
+        set_path(path);
+        set_text(std::move(text));
+    }
+
+    explicit file_t(path_reference path, mapped_region&& region) : file_t() {
+        set_path(path);
+        set_region(std::move(region));
+    }
+
+    explicit file_t(path_reference path, shared_buffer buffer) : file_t() {
+        set_path(path);
+        set_buffer(std::move(buffer));
+    }
+
+    explicit file_t(path_reference path, const char* text) = delete;
+
+    file_t(const file_t& other) :
+        text_(other.text_),
+        path_(other.path_),
+        lines_(other.lines_.load()),
+        indexed_(other.indexed_.load())
+    {}
+
+    file_t(file_t&& other) noexcept :
+        text_(std::move(other.text_)),
+        path_(std::move(other.path_)),
+        lines_(other.lines_.exchange(nullptr)),
+        indexed_(other.indexed_.exchange(false))
+    {}
+
+    ~file_t() = default;
+
+public:
+    file_t& operator=(const file_t& other) {
+        if (this != &other) {
+            text_ = other.text_;
+            path_ = other.path_;
+            lines_.store(other.lines_.load());
+            indexed_.store(other.indexed_.load());
+        }
+        return *this;
+    }
+
+    file_t& operator=(file_t&& other) noexcept {
+        if (this != &other) {
+            text_ = std::move(other.text_);
+            path_ = std::move(other.path_);
+            lines_.store(other.lines_.exchange(nullptr));
+            indexed_.store(other.indexed_.exchange(false));
+        }
+        return *this;
+    }
+
+public:
+    void set_path(path_reference path) {
+        fs::path tmp_path{path};
+        tmp_path = tmp_path.remove_filename();
+        if (fs::exists(tmp_path)) {
+            path_ = path;
+            if (fs::is_directory(path))
+                path_ /= "temporary_file.txt";
+        }
+    }
+
+    void set_path(string_reference path) {
+        set_path(fs::path(path));
+    }
+
+    void set_filename(string_reference name) {
+        path_.replace_filename(fs::path(name));
+    }
+
+    void set_text(string_reference text) {
+        lines_.store(nullptr);
+        text_ = shared_buffer(std::string(text));
+    }
+
+    void set_text(std::string&& text) {
+        lines_.store(nullptr);
+        text_ = shared_buffer(std::move(text));
+    }
+
+    void set_text(const char* text, size_type size) {
+        lines_.store(nullptr);
+        text_ = shared_buffer(std::string(text, size));
+    }
+
+    void set_text(const char* text) = delete;
+
+    void set_region(mapped_region&& region) {
+        lines_.store(nullptr);
+        text_ = shared_buffer(std::move(region));
+    }
+
+    void set_buffer(shared_buffer buffer) noexcept {
+        lines_.store(nullptr);
+        text_ = std::move(buffer);
+    }
+
+    bool advise(mapped_region::advice hint) const noexcept {
+        return text_.advise(hint);
+    }
+
+public:
+    std::string get_text() const { return std::string(text_.view()); }
+
+    std::string take_text() {
+        lines_.store(nullptr);
+        return text_.take();
+    }
+
+    std::string_view view() const noexcept { return text_.view(); }
+
+    std::span<const char> span() const noexcept { return text_.span(); }
+
+    shared_buffer get_buffer() const { return text_; }
+
+    file_t slice(size_type pos, size_type count = shared_buffer::npos) const {
+        file_t file(*this);
+        file.text_ = text_.slice(pos, count);
+        file.lines_.store(nullptr);
+        return file;
+    }
+
+    fs::path get_path_fs() const { return path_; }
+
+    std::string get_path() const { return path_.generic_string(); }
+
+    fs::path get_dir_fs() const { return path_.parent_path(); }
+
+    std::string get_dir() const { return path_.parent_path().generic_string(); }
+
+    std::string get_filename() const { return path_.filename().generic_string(); }
+
+public:
+    /*
+        The first call unshares the buffer and drops a published line index;
+        after that a call costs one relaxed load besides the indexing
+    */
+    char& operator[](int index) {
+        if (indexed_.load(std::memory_order_relaxed)) {
+            indexed_.store(false, std::memory_order_relaxed);
+            lines_.store(nullptr);
+        }
+        return text_.mutable_data()[index];
+    }
+
+    char operator[](int index) const {
+        return text_.data()[index];
+    }
+
+public:
+    std::size_t size() const noexcept { return text_.size(); }
+
+    bool empty() const noexcept { return text_.empty(); }
+
+    bool is_mapped() const noexcept { return text_.is_mapped(); }
+
+    bool exists() const noexcept {
+        std::error_code error;
+        fs::file_status status{fs::status(path_, error)};
+        return fs::exists(status) && !fs::is_directory(status);
+    }
+
+public:
+    /*
+        Content fingerprint (see hash::tree_hash), hashed in parallel for
+        large buffers; threads = 0 uses every core.
+    */
+    hash::hash128 fingerprint(size_type threads = 0) const {
+        return hash::tree_hash::compute(text_.data(), text_.size(), threads);
+    }
+
+    std::uint32_t checksum(size_type threads = 0) const {
+        return hash::crc32c::compute_parallel(text_.data(), text_.size(), threads);
+    }
+
+    bool validate_utf8() const noexcept {
+        return unicode::validate_utf8(view());
+    }
+
+public:
+    /*
+        Line access through a line_index built on first use and shared by
+        copies; n and the returned line numbers are 0-based. The index is
+        handed out as a shared_ptr so it outlives a reset of this file.
+    */
+    std::string_view line(size_type n) const {
+        auto [begin, end]{index_lines()->bounds(n)};
+        return view().substr(begin, end - begin);
+    }
+
+    size_type line_count() const { return index_lines()->line_count(); }
+
+    size_type line_of_offset(size_type offset) const { return index_lines()->line_of_offset(offset); }
+
+    std::shared_ptr<const line_index> index_lines(size_type threads = 0) const {
+        std::shared_ptr<const line_index> index{lines_.load()};
+        if (!index) {
+            std::shared_ptr<const line_index> built{std::make_shared<const line_index>(view(), threads)};
+            if (lines_.compare_exchange_strong(index, built)) {
+                indexed_.store(true, std::memory_order_relaxed);
+                index = std::move(built);
+            }
+        }
+        return index;
+    }
+
+    bool save_line_index() const {
+        return index_lines()->save(path_);
+    }
+
+    /*
+        Fails when an index is already published for this buffer
+    */
+    bool load_line_index() const {
+        if (lines_.load())
+            return false;
+
+        auto index{std::make_shared<line_index>()};
+        if (!index->load(path_) || index->text_size() != size())
+            return false;
+
+        std::shared_ptr<const line_index> expected;
+        if (!lines_.compare_exchange_strong(expected, std::shared_ptr<const line_index>(std::move(index))))
+            return false;
+        indexed_.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+public:
+    /*
+        Zero-copy view of the buffer as records. Throws when the size is
+        not a whole number of records or the storage is not aligned for T
+        (slices and read_files arena blocks may not be).
+    */
+    template <typename T>
+    std::span<const T> as_span() const {
+        static_assert(std::is_trivially_copyable_v<T>);
+        return records_of<T>(view());
+    }
+
+    template <typename T>
+    record_view<T> as_unaligned() const {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (size() % sizeof(T))
+            throw std::invalid_argument("Error: Size is not a multiple of the record size");
+        return record_view<T>(text_.data(), size() / sizeof(T));
+    }
+
+    /*
+        Like as_span() for files written by record_writer with a header;
+        a foreign byte order or another record size is rejected.
+    */
+    template <typename T>
+    std::span<const T> as_records() const {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= sizeof(record_header));
+
+        record_header head;
+        if (size() < sizeof(head))
+            throw std::invalid_argument("Error: Missing record header");
+        std::memcpy(&head, text_.data(), sizeof(head));
+
+        if (head.magic != record_header::signature)
+            throw std::invalid_argument("Error: Missing record header");
+        if (head.order != record_header::byte_order)
+            throw std::invalid_argument("Error: Records have foreign byte order");
+        if (head.record_size != sizeof(T) || head.record_align != alignof(T))
+            throw std::invalid_argument("Error: Record size mismatch");
+        return records_of<T>(view().substr(sizeof(head)));
+    }
+
+private:
+    template <typename T>
+    static std::span<const T> records_of(std::string_view bytes) {
+        if (bytes.size() % sizeof(T))
+            throw std::invalid_argument("Error: Size is not a multiple of the record size");
+        if (reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(T))
+            throw std::invalid_argument("Error: Records are not aligned");
+        return std::span<const T>(reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T));
+    }
+
+private:
+    struct verified_path {};
+
+    explicit file_t(verified_path, path_reference path, shared_buffer buffer) :
+        text_(std::move(buffer)),
+        path_(path)
+    {}
+
+    friend class monitoring;
+
+private:
+    shared_buffer text_;
+    fs::path path_;
+    mutable std::atomic<std::shared_ptr<const line_index>> lines_;
+    mutable std::atomic<bool> indexed_{};
+};
+
+/*
+    Sequential chunked reader. Memory stays at depth chunks plus the longest
+    line that crosses a chunk boundary. Iterate either chunks or lines().
+    With depth > 1 a background thread keeps reading ahead into a ring of
+    buffers while the consumer works on the current chunk.
+*/
+class stream_t {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+
+public:
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = std::string_view;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const std::string_view*;
+        using reference         = const std::string_view&;
+
+    public:
+        iterator() = default;
+
+        explicit iterator(stream_t* stream) : stream_(stream) {
+            ++(*this);
+        }
+
+    public:
+        reference operator*() const noexcept { return chunk_; }
+
+        pointer operator->() const noexcept { return &chunk_; }
+
+        iterator& operator++() {
+            if (!stream_->next(chunk_))
+                stream_ = nullptr;
+            return *this;
+        }
+
+        void operator++(int) { ++(*this); }
+
+        bool operator==(const iterator& other) const noexcept { return stream_ == other.stream_; }
+
+    private:
+        stream_t* stream_{};
+        std::string_view chunk_;
+    };
+
+    class line_range {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type        = std::string_view;
+            using difference_type   = std::ptrdiff_t;
+            using pointer           = const std::string_view*;
+            using reference         = const std::string_view&;
+
+        public:
+            iterator() = default;
+
+            explicit iterator(stream_t* stream) : stream_(stream) {
+                ++(*this);
+            }
+
+        public:
+            reference operator*() const noexcept { return line_; }
+
+            pointer operator->() const noexcept { return &line_; }
+
+            iterator& operator++() {
+                if (!stream_->next_line(line_))
+                    stream_ = nullptr;
+                return *this;
+            }
+
+            void operator++(int) { ++(*this); }
+
+            bool operator==(const iterator& other) const noexcept { return stream_ == other.stream_; }
+
+        private:
+            stream_t* stream_{};
+            std::string_view line_;
+        };
+
+    public:
+        explicit line_range(stream_t* stream) noexcept : stream_(stream) {}
+
+    public:
+        iterator begin() { return iterator(stream_); }
+
+        iterator end() noexcept { return iterator(); }
+
+    private:
+        stream_t* stream_;
+    };
+
+public:
+    explicit stream_t(path_reference path, size_type chunk_size = 1024 * 1024, size_type depth = 1) :
+        fd_(::open(path.c_str(), O_RDONLY | O_CLOEXEC)),
+        chunk_size_(chunk_size)
+    {
+        if (!chunk_size_ || !depth)
+            throw std::invalid_argument("Incorrect argument");
+
+        if (!fd_) {
+            std::string error_text{"Error: Cannot open file: "};
+            std::string filename{path.filename().generic_string()};
+            throw std::ios_base::failure(error_text + filename);
+        }
+
+        ::posix_fadvise(fd_.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        if (depth == 1) {
+            buffer_ = std::make_unique_for_overwrite<char[]>(chunk_size_);
+        } else {
+            readahead_ = std::make_unique<readahead>(fd_.get(), chunk_size_, depth);
+        }
+    }
+
+    stream_t(const stream_t&) = delete;
+
+    stream_t(stream_t&&) noexcept = default;
+
+    ~stream_t() = default;
+
+public:
+    stream_t& operator=(const stream_t&) = delete;
+
+    stream_t& operator=(stream_t&&) noexcept = default;
+
+public:
+    iterator begin() { return iterator(this); }
+
+    iterator end() noexcept { return iterator(); }
+
+    line_range lines() noexcept { return line_range(this); }
+
+    bool next(std::string_view& chunk) {
+        if (readahead_)
+            return readahead_->next(chunk);
+
+        size_type done{read_full(fd_.get(), buffer_.get(), chunk_size_)};
+        chunk = std::string_view(buffer_.get(), done);
+        return done;
+    }
+
+    /*
+        Both consume the chunks not read yet and match the file_t results
+    */
+    hash::hash128 fingerprint() {
+        hash::tree_hash state;
+        for (std::string_view chunk; next(chunk);)
+            state.update(chunk);
+        return state.digest();
+    }
+
+    std::uint32_t checksum() {
+        hash::crc32c state;
+        for (std::string_view chunk; next(chunk);)
+            state.update(chunk);
+        return state.digest();
+    }
+
+    /*
+        Stops reading at the first chunk that makes the text invalid
+    */
+    bool validate_utf8() {
+        unicode::utf8_validator validator;
+        for (std::string_view chunk; next(chunk);) {
+            if (!validator.update(chunk))
+                return false;
+        }
+        return validator.finish();
+    }
+
+    bool next_line(std::string_view& line) {
+        if (carry_used_) {
+            carry_.clear();
+            carry_used_ = false;
+        }
+
+        while (true) {
+            if (!pending_.empty()) {
+                const void* found{std::memchr(pending_.data(), '\n', pending_.size())};
+                if (found) {
+                    size_type length{static_cast<size_type>(static_cast<const char*>(found) - pending_.data())};
+                    if (carry_.empty()) {
+                        line = pending_.substr(0, length);
+                    } else {
+                        carry_.append(pending_.data(), length);
+                        line = carry_;
+                        carry_used_ = true;
+                    }
+                    pending_.remove_prefix(length + 1);
+                    return true;
+                }
+                carry_.append(pending_);
+                pending_ = {};
+            }
+
+            std::string_view chunk;
+            if (!next(chunk)) {
+                if (carry_.empty())
+                    return false;
+                line = carry_;
+                carry_used_ = true;
+                return true;
+            }
+            pending_ = chunk;
+        }
+    }
+
+private:
+    /*
+        Ring of depth buffers shared with the I/O thread. A buffer counts as
+        taken from the moment it is filled until the consumer asks for the next
+        chunk, so the thread never overwrites the chunk being processed.
+    */
+    class readahead {
+    public:
+        explicit readahead(int fd, size_type chunk_size, size_type depth) :
+            chunk_size_(chunk_size),
+            buffers_(depth),
+            sizes_(depth)
+        {
+            for (auto& buffer : buffers_)
+                buffer = std::make_unique_for_overwrite<char[]>(chunk_size_);
+            thread_ = std::thread([this, fd] { run(fd); });
+        }
+
+        readahead(const readahead&) = delete;
+
+        ~readahead() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            free_cv_.notify_one();
+            thread_.join();
+        }
+
+    public:
+        readahead& operator=(const readahead&) = delete;
+
+    public:
+        bool next(std::string_view& chunk) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (holding_) {
+                head_ = (head_ + 1) % buffers_.size();
+                --taken_;
+                holding_ = false;
+                free_cv_.notify_one();
+            }
+
+            filled_cv_.wait(lock, [this] { return taken_ || done_; });
+            if (!taken_) {
+                if (error_)
+                    std::rethrow_exception(error_);
+                return false;
+            }
+
+            holding_ = true;
+            chunk = std::string_view(buffers_[head_].get(), sizes_[head_]);
+            return true;
+        }
+
+    private:
+        void run(int fd) {
+            try {
+                while (true) {
+                    size_type index{};
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        free_cv_.wait(lock, [this] { return taken_ < buffers_.size() || stop_; });
+                        if (stop_)
+                            return;
+                        index = (head_ + taken_) % buffers_.size();
+                    }
+
+                    size_type size{read_full(fd, buffers_[index].get(), chunk_size_)};
+
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (!size) {
+                        done_ = true;
+                    } else {
+                        sizes_[index] = size;
+                        ++taken_;
+                    }
+                    filled_cv_.notify_one();
+                    if (done_)
+                        return;
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                error_ = std::current_exception();
+                done_ = true;
+                filled_cv_.notify_one();
+            }
+        }
+
+    private:
+        size_type chunk_size_;
+        std::vector<std::unique_ptr<char[]>> buffers_;
+        std::vector<size_type> sizes_;
+        size_type head_{};
+        size_type taken_{};
+        bool holding_{};
+        bool done_{};
+        bool stop_{};
+        std::exception_ptr error_;
+        std::mutex mutex_;
+        std::condition_variable filled_cv_;
+        std::condition_variable free_cv_;
+        std::thread thread_;
+    };
+
+private:
+    descriptor fd_;
+    size_type chunk_size_;
+    std::unique_ptr<char[]> buffer_;
+    std::unique_ptr<readahead> readahead_;
+    std::string_view pending_;
+    std::string carry_;
+    bool carry_used_{};
+};
+
+#if defined(__linux__)
+/*
+    Asynchronous file operations. Uses io_uring when the kernel provides it
+    (5.6+ for open/statx) and a thread pool running the blocking calls
+    otherwise. Operations are queued, sent with submit() and reported as
+    completions carrying the caller's user_data and a result that is the
+    syscall return value or -errno. Buffers, paths and statx outputs must
+    stay alive until the matching completion is reaped. A read or write
+    covers less than 4 GiB, the limit of the ring's 32-bit length, and
+    like pread and pwrite it can complete short.
+*/
+class async_io {
+private:
+    using size_type = std::size_t;
+
+public:
+    enum class backend { io_uring, thread_pool };
+
+    struct completion {
+        std::uint64_t user_data{};
+        std::int64_t result{};
+    };
+
+public:
+    explicit async_io(unsigned entries = 4096, bool use_fallback = false) {
+        if (!entries)
+            throw std::invalid_argument("Incorrect argument");
+
+        if (use_fallback || !setup_ring(entries))
+            pool_ = std::make_unique<thread::pool>(std::max<size_type>(4, std::thread::hardware_concurrency()));
+    }
+
+    async_io(const async_io&) = delete;
+
+    /*
+        Errors while finishing the outstanding operations are dropped,
+        drain() first to see them
+    */
+    ~async_io() {
+        try {
+            drain();
+        } catch (...) {
+        }
+        if (!pool_)
+            teardown_ring();
+    }
+
+public:
+    async_io& operator=(const async_io&) = delete;
+
+public:
+    backend get_backend() const noexcept { return pool_ ? backend::thread_pool : backend::io_uring; }
+
+    void read(int fd, void* buffer, size_type size, std::uint64_t offset, std::uint64_t user_data, bool fixed_file = false) {
+        queue({ op::read, fd, buffer, size, offset, user_data, fixed_file });
+    }
+
+    void write(int fd, const void* buffer, size_type size, std::uint64_t offset, std::uint64_t user_data, bool fixed_file = false) {
+        queue({ op::write, fd, const_cast<void*>(buffer), size, offset, user_data, fixed_file });
+    }
+
+    void read_fixed(int fd, unsigned buffer_index, size_type size, std::uint64_t offset, std::uint64_t user_data, bool fixed_file = false) {
+        operation operation{ op::read_fixed, fd, fixed_buffer(buffer_index, size), size, offset, user_data, fixed_file };
+        operation.buffer_index = buffer_index;
+        queue(operation);
+    }
+
+    void write_fixed(int fd, unsigned buffer_index, size_type size, std::uint64_t offset, std::uint64_t user_data, bool fixed_file = false) {
+        operation operation{ op::write_fixed, fd, fixed_buffer(buffer_index, size), size, offset, user_data, fixed_file };
+        operation.buffer_index = buffer_index;
+        queue(operation);
+    }
+
+    void open(int dir_fd, const char* path, int flags, mode_t mode, std::uint64_t user_data) {
+        operation operation{ op::open, dir_fd, nullptr, 0, 0, user_data, false };
+        operation.path = path;
+        operation.flags = flags | O_CLOEXEC;
+        operation.mode = mode;
+        queue(operation);
+    }
+
+    void statx(int dir_fd, const char* path, int flags, unsigned mask, struct ::statx* out, std::uint64_t user_data) {
+        operation operation{ op::statx, dir_fd, out, 0, 0, user_data, false };
+        operation.path = path;
+        operation.flags = flags;
+        operation.mask = mask;
+        queue(operation);
+    }
+
+    void fsync(int fd, bool data_only, std::uint64_t user_data, bool fixed_file = false) {
+        operation operation{ op::fsync, fd, nullptr, 0, 0, user_data, fixed_file };
+        operation.flags = data_only;
+        queue(operation);
+    }
+
+    void register_buffers(std::span<const iovec> buffers) {
+        if (!pool_ && ::syscall(__NR_io_uring_register, ring_fd_.get(), IORING_REGISTER_BUFFERS,
+                                buffers.data(), static_cast<unsigned>(buffers.size())) == -1)
+            throw std::ios_base::failure("Error: Cannot register buffers");
+        buffers_.assign(buffers.begin(), buffers.end());
+    }
+
+    void register_files(std::span<const int> files) {
+        if (!pool_ && ::syscall(__NR_io_uring_register, ring_fd_.get(), IORING_REGISTER_FILES,
+                                files.data(), static_cast<unsigned>(files.size())) == -1)
+            throw std::ios_base::failure("Error: Cannot register files");
+        files_.assign(files.begin(), files.end());
+    }
+
+    size_type submit() {
+        if (pool_) {
+            size_type count{queued_.size()};
+            for (const auto& operation : queued_) {
+                pool_->submit([this, operation] {
+                    completion done{ operation.user_data, execute(operation) };
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    completed_.push_back(done);
+                    completed_cv_.notify_all();
+                });
+            }
+            in_flight_ += count;
+            queued_.clear();
+            return count;
+        }
+
+        return enter(0);
+    }
+
+    size_type wait(std::vector<completion>& out, size_type min_count = 1) {
+        min_count = std::min(min_count, in_flight_ + to_submit_ + queued_.size() + overflow_.size());
+        if (queued_.size() || to_submit_)
+            submit();
+
+        if (pool_) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            completed_cv_.wait(lock, [this, min_count] { return completed_.size() >= min_count; });
+            return drain_completed(out);
+        }
+
+        size_type count{reap(out)};
+        while (count < min_count) {
+            enter(min_count - count);
+            count += reap(out);
+        }
+        return count;
+    }
+
+    size_type peek(std::vector<completion>& out) {
+        if (pool_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return drain_completed(out);
+        }
+        return reap(out);
+    }
+
+    size_type in_flight() const noexcept { return in_flight_ + to_submit_ + queued_.size(); }
+
+    /*
+        Submits what is queued and waits for every operation to finish,
+        dropping the completions nobody reaped
+    */
+    void drain() {
+        if (pool_) {
+            submit();
+            pool_->wait();
+            std::lock_guard<std::mutex> lock(mutex_);
+            in_flight_ -= completed_.size();
+            completed_.clear();
+            return;
+        }
+
+        std::vector<completion> rest;
+        while (in_flight_ || to_submit_)
+            wait(rest, in_flight_ + to_submit_);
+        overflow_.clear();
+    }
+
+private:
+    enum class op { read, write, read_fixed, write_fixed, open, statx, fsync };
+
+    struct operation {
+        op type;
+        int fd;
+        void* buffer;
+        size_type size;
+        std::uint64_t offset;
+        std::uint64_t user_data;
+        bool fixed_file;
+        unsigned buffer_index{};
+        const char* path{};
+        int flags{};
+        mode_t mode{};
+        unsigned mask{};
+    };
+
+private:
+    void* fixed_buffer(unsigned index, size_type size) const {
+        if (index >= buffers_.size() || size > buffers_[index].iov_len)
+            throw std::invalid_argument("Incorrect argument");
+        return buffers_[index].iov_base;
+    }
+
+    void queue(const operation& operation) {
+        if (operation.fixed_file && static_cast<size_type>(operation.fd) >= files_.size())
+            throw std::invalid_argument("Incorrect argument");
+        if (operation.size > std::numeric_limits<unsigned>::max())
+            throw std::invalid_argument("Incorrect argument");
+
+        if (pool_) {
+            queued_.push_back(operation);
+            return;
+        }
+
+        while (!push(operation)) {
+            if (reap(overflow_))
+                continue;
+            if (to_submit_ && enter(0))
+                continue;
+            enter(1);
+        }
+    }
+
+    std::int64_t execute(const operation& operation) const noexcept {
+        int fd{operation.fixed_file ? files_[operation.fd] : operation.fd};
+        char* buffer{static_cast<char*>(operation.buffer)};
+        long result{-1};
+
+        switch (operation.type) {
+            case op::read:
+            case op::read_fixed:
+                result = ::pread(fd, buffer, operation.size, static_cast<off_t>(operation.offset));
+                break;
+            case op::write:
+            case op::write_fixed:
+                result = ::pwrite(fd, buffer, operation.size, static_cast<off_t>(operation.offset));
+                break;
+            case op::open:
+                result = ::openat(fd, operation.path, operation.flags, operation.mode);
+                break;
+            case op::statx:
+                result = ::statx(fd, operation.path, operation.flags, operation.mask,
+                                 static_cast<struct ::statx*>(operation.buffer));
+                break;
+            case op::fsync:
+                result = operation.flags ? ::fdatasync(fd) : ::fsync(fd);
+                break;
+        }
+
+        return result == -1 ? -errno : result;
+    }
+
+    size_type drain_completed(std::vector<completion>& out) {
+        size_type count{completed_.size()};
+        out.insert(out.end(), completed_.begin(), completed_.end());
+        completed_.clear();
+        in_flight_ -= count;
+        return count;
+    }
+
+private:
+    bool setup_ring(unsigned entries) {
+        io_uring_params params{};
+        ring_fd_ = descriptor(static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params)));
+        if (!ring_fd_)
+            return false;
+
+        if (!(params.features & IORING_FEAT_RW_CUR_POS) || !(params.features & IORING_FEAT_NODROP)) {
+            ring_fd_.close();
+            return false;
+        }
+
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_map{static_cast<bool>(params.features & IORING_FEAT_SINGLE_MMAP)};
+        if (single_map)
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+
+        sq_ring_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd_.get(), IORING_OFF_SQ_RING);
+        cq_ring_ = single_map ? sq_ring_ :
+                   ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd_.get(), IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes{::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd_.get(), IORING_OFF_SQES)};
+
+        if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes == MAP_FAILED) {
+            if (sqes != MAP_FAILED)
+                ::munmap(sqes, sqes_size_);
+            if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+                ::munmap(cq_ring_, cq_size_);
+            if (sq_ring_ != MAP_FAILED)
+                ::munmap(sq_ring_, sq_size_);
+            sq_ring_ = cq_ring_ = nullptr;
+            ring_fd_.close();
+            return false;
+        }
+
+        char* sq{static_cast<char*>(sq_ring_)};
+        char* cq{static_cast<char*>(cq_ring_)};
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sq_entries_ = params.sq_entries;
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cq_entries_ = params.cq_entries;
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+        return true;
+    }
+
+    void teardown_ring() noexcept {
+        if (!sq_ring_)
+            return;
+        ::munmap(sqes_, sqes_size_);
+        if (cq_ring_ != sq_ring_)
+            ::munmap(cq_ring_, cq_size_);
+        ::munmap(sq_ring_, sq_size_);
+    }
+
+    bool push(const operation& operation) {
+        if (in_flight_ + to_submit_ >= cq_entries_)
+            return false;
+
+        unsigned tail{*sq_tail_};
+        unsigned head{std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire)};
+        if (tail - head >= sq_entries_)
+            return false;
+
+        unsigned index{tail & sq_mask_};
+        io_uring_sqe& sqe{sqes_[index]};
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.fd = operation.fd;
+        sqe.user_data = operation.user_data;
+        if (operation.fixed_file)
+            sqe.flags |= IOSQE_FIXED_FILE;
+
+        switch (operation.type) {
+            case op::read:
+            case op::write:
+            case op::read_fixed:
+            case op::write_fixed:
+                sqe.opcode = operation.type == op::read ? IORING_OP_READ :
+                             operation.type == op::write ? IORING_OP_WRITE :
+                             operation.type == op::read_fixed ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+                sqe.addr = reinterpret_cast<std::uint64_t>(operation.buffer);
+                sqe.len = static_cast<unsigned>(operation.size);
+                sqe.off = operation.offset;
+                sqe.buf_index = static_cast<std::uint16_t>(operation.buffer_index);
+                break;
+            case op::open:
+                sqe.opcode = IORING_OP_OPENAT;
+                sqe.addr = reinterpret_cast<std::uint64_t>(operation.path);
+                sqe.len = operation.mode;
+                sqe.open_flags = static_cast<unsigned>(operation.flags);
+                break;
+            case op::statx:
+                sqe.opcode = IORING_OP_STATX;
+                sqe.addr = reinterpret_cast<std::uint64_t>(operation.path);
+                sqe.len = operation.mask;
+                sqe.off = reinterpret_cast<std::uint64_t>(operation.buffer);
+                sqe.statx_flags = static_cast<unsigned>(operation.flags);
+                break;
+            case op::fsync:
+                sqe.opcode = IORING_OP_FSYNC;
+                sqe.fsync_flags = operation.flags ? IORING_FSYNC_DATASYNC : 0;
+                break;
+        }
+
+        sq_array_[index] = index;
+        std::atomic_ref<unsigned>(*sq_tail_).store(tail + 1, std::memory_order_release);
+        ++to_submit_;
+        return true;
+    }
+
+    size_type enter(size_type min_complete) {
+        unsigned flags{min_complete ? IORING_ENTER_GETEVENTS : 0u};
+        while (true) {
+            long result{::syscall(__NR_io_uring_enter, ring_fd_.get(), to_submit_,
+                                  static_cast<unsigned>(min_complete), flags, nullptr, 0)};
+            if (result == -1) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EBUSY)
+                    return 0;
+                throw std::ios_base::failure("Error: io_uring_enter failed");
+            }
+            size_type submitted{static_cast<size_type>(result)};
+            to_submit_ -= submitted;
+            in_flight_ += submitted;
+            return submitted;
+        }
+    }
+
+    size_type reap(std::vector<completion>& out) {
+        size_type count{overflow_.size()};
+        if (&out != &overflow_ && count) {
+            out.insert(out.end(), overflow_.begin(), overflow_.end());
+            overflow_.clear();
+        } else {
+            count = 0;
+        }
+
+        unsigned head{*cq_head_};
+        unsigned tail{std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire)};
+        for (; head != tail; ++head, ++count) {
+            const io_uring_cqe& cqe{cqes_[head & cq_mask_]};
+            out.push_back({ cqe.user_data, cqe.res });
+            --in_flight_;
+        }
+        std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+        return count;
+    }
+
+private:
+    descriptor ring_fd_;
+    void* sq_ring_{};
+    void* cq_ring_{};
+    size_type sq_size_{};
+    size_type cq_size_{};
+    size_type sqes_size_{};
+    unsigned* sq_head_{};
+    unsigned* sq_tail_{};
+    unsigned* sq_array_{};
+    unsigned sq_mask_{};
+    unsigned sq_entries_{};
+    unsigned* cq_head_{};
+    unsigned* cq_tail_{};
+    unsigned cq_mask_{};
+    unsigned cq_entries_{};
+    io_uring_cqe* cqes_{};
+    io_uring_sqe* sqes_{};
+    size_type to_submit_{};
+    size_type in_flight_{};
+    std::vector<completion> overflow_;
+
+    std::vector<iovec> buffers_;
+    std::vector<int> files_;
+
+    std::unique_ptr<thread::pool> pool_;
+    std::vector<operation> queued_;
+    std::vector<completion> completed_;
+    std::mutex mutex_;
+    std::condition_variable completed_cv_;
+};
+#endif
+
+/*
+    Appending writer that keeps the file open. Producers push records into a
+    lock-free queue; a background thread drains it into one write(2) per
+    batch once flush_size bytes are pending or flush_interval has passed.
+    With sync_policy::batch every batch is followed by one fdatasync that
+    commits all of its records together, sync_policy::interval syncs at
+    most once per sync_interval, and a record is synced within about one
+    sync_interval even when nothing is appended after it. Under either policy the destructor syncs
+    whatever was written since the last sync before closing.
+*/
+class append_writer {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+    using milliseconds   = std::chrono::milliseconds;
+
+public:
+    enum class sync_policy { none, batch, interval };
+
+    struct options {
+        size_type flush_size{64 * 1024};
+        milliseconds flush_interval{100};
+        sync_policy sync{sync_policy::none};
+        milliseconds sync_interval{1000};
+    };
+
+public:
+    explicit append_writer(path_reference path) : append_writer(path, options()) {}
+
+    explicit append_writer(path_reference path, options opts) :
+        fd_(::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)),
+        options_(opts),
+        head_(&stub_),
+        tail_(&stub_)
+    {
+        if (!fd_) {
+            std::string error_text{"Error: Cannot open file: "};
+            std::string filename{path.filename().generic_string()};
+            throw std::ios_base::failure(error_text + filename);
+        }
+        writer_ = std::thread([this] { run(); });
+    }
+
+    append_writer(const append_writer&) = delete;
+
+    ~append_writer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_cv_.notify_one();
+        writer_.join();
+    }
+
+public:
+    append_writer& operator=(const append_writer&) = delete;
+
+public:
+    void append(std::string_view record) {
+        check_error();
+
+        node* item{new node};
+        item->data.assign(record);
+
+        node* prev{head_.exchange(item, std::memory_order_acq_rel)};
+        prev->next.store(item, std::memory_order_release);
+        enqueued_.fetch_add(1, std::memory_order_release);
+
+        size_type pending{pending_bytes_.fetch_add(record.size(), std::memory_order_relaxed) + record.size()};
+        if (pending >= options_.flush_size && pending - record.size() < options_.flush_size)
+            wake_cv_.notify_one();
+    }
+
+    void flush() {
+        wait_for(written_, false);
+    }
+
+    void sync() {
+        wait_for(synced_, true);
+    }
+
+    /*
+        Number of appended records that have been fdatasync'ed
+    */
+    size_type synced() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return synced_;
+    }
+
+private:
+    struct node {
+        std::atomic<node*> next{};
+        std::string data;
+    };
+
+private:
+    void wait_for(const size_type& counter, bool sync) {
+        size_type target{enqueued_.load(std::memory_order_acquire)};
+        std::unique_lock<std::mutex> lock(mutex_);
+        ++waiters_;
+        sync_requested_ = sync_requested_ || sync;
+        wake_cv_.notify_one();
+        done_cv_.wait(lock, [this, &counter, target] { return counter >= target || error_; });
+        --waiters_;
+        if (error_)
+            throw std::ios_base::failure("Error: Cannot write file", error_);
+    }
+
+    void check_error() {
+        if (failed_.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            throw std::ios_base::failure("Error: Cannot write file", error_);
+        }
+    }
+
+    node* pop() noexcept {
+        node* tail{tail_};
+        node* next{tail->next.load(std::memory_order_acquire)};
+        if (!next)
+            return nullptr;
+
+        tail_ = next;
+        if (tail != &stub_)
+            delete tail;
+        return next;
+    }
+
+    void run() {
+        std::string batch;
+        auto last_sync{std::chrono::steady_clock::now()};
+
+        while (true) {
+            bool stopping{};
+            bool sync_now{};
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_cv_.wait_for(lock, options_.flush_interval, [this] {
+                    return stop_ || waiters_ ||
+                           pending_bytes_.load(std::memory_order_relaxed) >= options_.flush_size;
+                });
+                stopping = stop_;
+                sync_now = std::exchange(sync_requested_, false);
+            }
+
+            size_type count{};
+            batch.clear();
+            while (node* item{pop()}) {
+                batch.append(item->data);
+                item->data = std::string();
+                ++count;
+            }
+            pending_bytes_.fetch_sub(batch.size(), std::memory_order_relaxed);
+
+            std::error_code error;
+            if (!batch.empty())
+                write_full(fd_.get(), batch, error);
+
+            auto now{std::chrono::steady_clock::now()};
+            bool last{stopping && !tail_->next.load(std::memory_order_acquire)};
+            bool do_sync{!error && (sync_now ||
+                         (count && options_.sync == sync_policy::batch) ||
+                         (options_.sync == sync_policy::interval && synced_ < written_ + count &&
+                          now - last_sync >= options_.sync_interval) ||
+                         (last && options_.sync != sync_policy::none && synced_ < written_ + count))};
+            if (do_sync) {
+                if (::fdatasync(fd_.get()) == -1)
+                    error = std::error_code(errno, std::system_category());
+                last_sync = now;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                written_ += count;
+                if (do_sync)
+                    synced_ = written_;
+                if (error) {
+                    error_ = error;
+                    failed_.store(true, std::memory_order_release);
+                }
+            }
+            done_cv_.notify_all();
+
+            if (last)
+                break;
+        }
+
+        if (tail_ != &stub_)
+            delete tail_;
+    }
+
+private:
+    descriptor fd_;
+    options options_;
+    node stub_;
+    std::atomic<node*> head_;
+    node* tail_;
+    std::atomic<size_type> enqueued_{};
+    std::atomic<size_type> pending_bytes_{};
+    size_type written_{};
+    size_type synced_{};
+    size_type waiters_{};
+    bool sync_requested_{};
+    bool stop_{};
+    std::error_code error_;
+    std::atomic<bool> failed_{};
+    mutable std::mutex mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable done_cv_;
+    std::thread writer_;
+};
+
+enum class durability { none, data, full };
+
+/*
+    Replacement of a file through a temporary in the same directory that is
+    renamed over the target on commit, so readers see either the old or the
+    new contents. On Linux the temporary is an unnamed O_TMPFILE that only
+    gets a name right before the rename. durability::data syncs the file
+    data, durability::full also syncs the directory entry.
+*/
+class atomic_file {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+
+public:
+    explicit atomic_file(path_reference path) :
+        path_(path)
+    {
+        fs::path dir{path_.parent_path()};
+        if (dir.empty())
+            dir = ".";
+
+        struct stat info{};
+        mode_t mode{0644};
+        if (::stat(path_.c_str(), &info) == 0)
+            mode = info.st_mode & 07777;
+
+#if defined(O_TMPFILE)
+        fd_ = descriptor(::open(dir.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, mode));
+#endif
+        if (!fd_)
+            open_named(dir, mode);
+
+        if (!fd_) {
+            std::string error_text{errno == EMFILE || errno == ENFILE ? "Error: Too many open files: "
+                                                                      : "Error: Cannot create file: "};
+            std::string filename{path_.filename().generic_string()};
+            throw std::ios_base::failure(error_text + filename);
+        }
+    }
+
+    atomic_file(const atomic_file&) = delete;
+
+    atomic_file(atomic_file&&) noexcept = default;
+
+    ~atomic_file() {
+        discard();
+    }
+
+public:
+    atomic_file& operator=(const atomic_file&) = delete;
+
+    atomic_file& operator=(atomic_file&& other) noexcept {
+        if (this != &other) {
+            discard();
+            path_ = std::move(other.path_);
+            temp_ = std::exchange(other.temp_, fs::path());
+            fd_ = std::move(other.fd_);
+        }
+        return *this;
+    }
+
+public:
+    int get() const noexcept { return fd_.get(); }
+
+    const fs::path& get_path() const noexcept { return path_; }
+
+    void write(std::string_view data) {
+        write_full(fd_.get(), data);
+    }
+
+    void sync(durability level) const {
+        if (level == durability::none)
+            return;
+
+        int result{level == durability::data ? ::fdatasync(fd_.get()) : ::fsync(fd_.get())};
+        if (result == -1)
+            throw std::ios_base::failure("Error: Cannot sync file");
+    }
+
+    void publish() {
+        if (temp_.empty())
+            link_temporary();
+
+        if (::rename(temp_.c_str(), path_.c_str()) == -1)
+            throw std::ios_base::failure("Error: Cannot replace file: " + path_.filename().generic_string());
+
+        temp_.clear();
+        fd_.close();
+    }
+
+    /*
+        Gives the temporary a name and closes it, so a pending replacement
+        stops holding a descriptor. Only publish and discard work afterwards
+    */
+    void park() {
+        if (temp_.empty())
+            link_temporary();
+        fd_.close();
+    }
+
+    void commit(durability level) {
+        sync(level);
+        publish();
+        if (level == durability::full)
+            sync_directory(path_.parent_path());
+    }
+
+    static void sync_directory(path_reference dir) {
+        descriptor fd(::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        if (!fd || ::fsync(fd.get()) == -1)
+            throw std::ios_base::failure("Error: Cannot sync directory");
+    }
+
+    /*
+        Drops the new contents: the temporary is unlinked and closed, the
+        target stays untouched
+    */
+    void discard() noexcept {
+        if (!temp_.empty())
+            ::unlink(temp_.c_str());
+        temp_.clear();
+        fd_.close();
+    }
+
+private:
+    fs::path temporary_name(path_reference dir) const {
+        static std::atomic<unsigned> counter{};
+        std::string name{"." + path_.filename().generic_string() + "." + std::to_string(::getpid()) +
+                         "." + std::to_string(counter.fetch_add(1, std::memory_order_relaxed)) + ".tmp"};
+        return dir / name;
+    }
+
+    void open_named(path_reference dir, mode_t mode) {
+        for (int attempt{}; attempt < 100 && !fd_; ++attempt) {
+            fs::path temp{temporary_name(dir)};
+            fd_ = descriptor(::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode));
+            if (fd_)
+                temp_ = std::move(temp);
+            else if (errno != EEXIST)
+                return;
+        }
+    }
+
+    void link_temporary() {
+        std::string proc_path{"/proc/self/fd/" + std::to_string(fd_.get())};
+        fs::path dir{path_.parent_path().empty() ? fs::path(".") : path_.parent_path()};
+        for (int attempt{}; attempt < 100; ++attempt) {
+            fs::path temp{temporary_name(dir)};
+            if (::linkat(AT_FDCWD, proc_path.c_str(), AT_FDCWD, temp.c_str(), AT_SYMLINK_FOLLOW) == 0) {
+                temp_ = std::move(temp);
+                return;
+            }
+            if (errno != EEXIST)
+                break;
+        }
+        throw std::ios_base::failure("Error: Cannot link file: " + path_.filename().generic_string());
+    }
+
+private:
+    fs::path path_;
+    fs::path temp_;
+    descriptor fd_;
+};
+
+/*
+    Group of atomic replacements committed together: file syncs are issued
+    concurrently, then every file is renamed into place and each parent
+    directory is synced once. A rename cannot be undone, so when one fails
+    the files not yet renamed are discarded, published() tells how many
+    made it, and the batch refuses another commit.
+
+    Every staged file holds a descriptor until it is synced. Once max_open
+    of them are open, they are synced together, linked under a temporary
+    name and closed, so large batches stay within the descriptor limit at
+    the cost of one more round of syncs per max_open files.
+*/
+class atomic_batch {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+
+public:
+    explicit atomic_batch(durability level = durability::full, size_type max_open = 256) :
+        level_(level),
+        max_open_(std::max<size_type>(max_open, 1))
+    {}
+
+    ~atomic_batch() = default;
+
+public:
+    void stage(path_reference path, std::string_view text) {
+        if (files_.size() - parked_ >= max_open_)
+            park_all();
+
+        atomic_file file(path);
+        file.write(text);
+        files_.push_back(std::move(file));
+    }
+
+    void stage(const file_t& file) {
+        stage(file.get_path_fs(), file.view());
+    }
+
+    size_type size() const noexcept { return files_.size(); }
+
+    size_type published() const noexcept { return published_; }
+
+    void commit() {
+        if (broken_)
+            throw std::ios_base::failure("Error: Batch was partially committed");
+
+        if (level_ != durability::none)
+            sync_all();
+
+        parked_ = 0;
+        published_ = 0;
+        std::vector<fs::path> dirs;
+        for (auto& file : files_) {
+            try {
+                file.publish();
+            } catch (...) {
+                broken_ = true;
+                files_.clear();
+                throw;
+            }
+            ++published_;
+            dirs.push_back(file.get_path().parent_path());
+        }
+        files_.clear();
+
+        if (level_ == durability::full) {
+            std::sort(dirs.begin(), dirs.end());
+            dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+            for (const auto& dir : dirs)
+                atomic_file::sync_directory(dir);
+        }
+    }
+
+private:
+    void park_all() {
+        if (level_ != durability::none)
+            sync_all();
+        for (; parked_ < files_.size(); ++parked_)
+            files_[parked_].park();
+    }
+
+    // Syncs the files staged since the last park_all
+    void sync_all() {
+        size_type count{files_.size() - parked_};
+#if defined(__linux__)
+        if (!io_)
+            io_ = std::make_unique<async_io>(static_cast<unsigned>(std::clamp<size_type>(count, 1, 4096)));
+        for (size_type i{parked_}; i < files_.size(); ++i)
+            io_->fsync(files_[i].get(), level_ == durability::data, i);
+
+        std::vector<async_io::completion> completions;
+        size_type done{};
+        while (done < count)
+            done += io_->wait(completions, count - done);
+
+        for (const auto& completion : completions) {
+            if (completion.result < 0)
+                throw std::ios_base::failure("Error: Cannot sync file");
+        }
+#else
+        for (size_type i{parked_}; i < files_.size(); ++i)
+            files_[i].sync(level_);
+#endif
+    }
+
+private:
+    durability level_;
+    size_type max_open_;
+    std::vector<atomic_file> files_;
+    size_type parked_{};
+    size_type published_{};
+    bool broken_{};
+#if defined(__linux__)
+    std::unique_ptr<async_io> io_;
+#endif
+};
+
+enum class symlink_policy { skip, report, follow };
+
+struct walk_entry {
+    fs::path path;
+    fs::file_type type{fs::file_type::unknown};
+    std::size_t depth{};
+};
+
+/*
+    Depths follow recursive_directory_iterator::depth(): entries directly
+    under the root are at depth 0, and directories at max_depth are
+    reported but not entered. on_error runs on the pool threads,
+    concurrently with visit and filter.
+*/
+struct walk_options {
+    std::size_t max_depth{std::numeric_limits<std::size_t>::max()};
+    symlink_policy symlinks{symlink_policy::report};
+    std::function<bool(const walk_entry&)> filter;
+    std::function<void(const fs::path&, std::error_code)> on_error;
+    std::size_t threads{};
+    std::size_t buffer_size{256 * 1024};
+};
+
+/*
+    Recursive directory traversal. Each directory is one task on a
+    work-stealing pool and is listed with getdents64 into a large buffer;
+    d_type decides file types, so entries are stat'ed only when the file
+    system does not report a type or a symlink has to be followed.
+    Entries rejected by the filter are neither reported nor descended into.
+    visit, filter and on_error are called concurrently from the worker
+    threads.
+*/
+class walker {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+    using visitor        = std::function<void(const walk_entry&)>;
+
+public:
+    explicit walker(const walk_options& options, visitor visit) :
+        options_(options),
+        visit_(std::move(visit))
+    {
+        if (!options_.buffer_size)
+            throw std::invalid_argument("Incorrect argument");
+    }
+
+public:
+    void run(path_reference root) {
+        size_type threads{options_.threads ? options_.threads :
+                          std::max<size_type>(1, std::thread::hardware_concurrency())};
+        thread::pool workers(threads);
+        pool_ = &workers;
+
+        if (options_.symlinks == symlink_policy::follow) {
+            struct stat info{};
+            if (::stat(root.c_str(), &info) == 0)
+                first_visit(info.st_dev, info.st_ino);
+        }
+
+        workers.submit([this, root] { list(root, 0); });
+        workers.wait();
+        pool_ = nullptr;
+    }
+
+private:
+    static fs::file_type to_file_type(unsigned char type) noexcept {
+        switch (type) {
+            case DT_REG:  return fs::file_type::regular;
+            case DT_DIR:  return fs::file_type::directory;
+            case DT_LNK:  return fs::file_type::symlink;
+            case DT_FIFO: return fs::file_type::fifo;
+            case DT_SOCK: return fs::file_type::socket;
+            case DT_CHR:  return fs::file_type::character;
+            case DT_BLK:  return fs::file_type::block;
+            default:      return fs::file_type::unknown;
+        }
+    }
+
+    static fs::file_type to_file_type(mode_t mode) noexcept {
+        if (S_ISREG(mode))  return fs::file_type::regular;
+        if (S_ISDIR(mode))  return fs::file_type::directory;
+        if (S_ISLNK(mode))  return fs::file_type::symlink;
+        if (S_ISFIFO(mode)) return fs::file_type::fifo;
+        if (S_ISSOCK(mode)) return fs::file_type::socket;
+        if (S_ISCHR(mode))  return fs::file_type::character;
+        if (S_ISBLK(mode))  return fs::file_type::block;
+        return fs::file_type::unknown;
+    }
+
+    bool first_visit(dev_t dev, ino_t ino) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return visited_.insert({ dev, ino }).second;
+    }
+
+    void report_error(path_reference path, int error) const {
+        if (options_.on_error)
+            options_.on_error(path, std::error_code(error, std::system_category()));
+    }
+
+    void entry(int dir_fd, path_reference dir, const char* name, unsigned char type, size_type depth) {
+        if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+            return;
+
+        walk_entry item{ dir / name, to_file_type(type), depth };
+        bool descend{};
+
+        if (item.type == fs::file_type::unknown) {
+            struct stat info{};
+            if (::fstatat(dir_fd, name, &info, AT_SYMLINK_NOFOLLOW) == 0)
+                item.type = to_file_type(info.st_mode);
+        }
+
+        if (item.type == fs::file_type::symlink) {
+            if (options_.symlinks == symlink_policy::skip)
+                return;
+            if (options_.symlinks == symlink_policy::follow) {
+                struct stat info{};
+                if (::fstatat(dir_fd, name, &info, 0) == 0 && S_ISDIR(info.st_mode))
+                    descend = first_visit(info.st_dev, info.st_ino);
+            }
+        } else if (item.type == fs::file_type::directory) {
+            descend = true;
+            if (options_.symlinks == symlink_policy::follow) {
+                struct stat info{};
+                descend = ::fstatat(dir_fd, name, &info, AT_SYMLINK_NOFOLLOW) == 0 &&
+                          first_visit(info.st_dev, info.st_ino);
+            }
+        }
+
+        if (options_.filter && !options_.filter(item))
+            return;
+
+        visit_(item);
+
+        if (descend && depth < options_.max_depth)
+            pool_->submit([this, path = std::move(item.path), depth] { list(path, depth + 1); });
+    }
+
+    void list(path_reference dir, size_type depth) {
+        descriptor fd(::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        if (!fd) {
+            report_error(dir, errno);
+            return;
+        }
+
+#if defined(__linux__)
+        struct linux_dirent64 {
+            std::uint64_t d_ino;
+            std::int64_t d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[1];
+        };
+
+        thread_local std::unique_ptr<char[]> buffer;
+        thread_local size_type buffer_size{};
+        if (buffer_size < options_.buffer_size) {
+            buffer = std::make_unique_for_overwrite<char[]>(options_.buffer_size);
+            buffer_size = options_.buffer_size;
+        }
+
+        while (true) {
+            long count{::syscall(SYS_getdents64, fd.get(), buffer.get(), options_.buffer_size)};
+            if (count == -1) {
+                if (errno == EINTR)
+                    continue;
+                report_error(dir, errno);
+                return;
+            }
+            if (count == 0)
+                return;
+
+            for (long offset{}; offset < count;) {
+                auto* item{reinterpret_cast<linux_dirent64*>(buffer.get() + offset)};
+                entry(fd.get(), dir, item->d_name, item->d_type, depth);
+                offset += item->d_reclen;
+            }
+        }
+#else
+        DIR* stream{::fdopendir(fd.get())};
+        if (!stream) {
+            report_error(dir, errno);
+            return;
+        }
+        fd.release();
+
+        while (dirent* item{::readdir(stream)})
+            entry(::dirfd(stream), dir, item->d_name, item->d_type, depth);
+        ::closedir(stream);
+#endif
+    }
+
+private:
+    const walk_options& options_;
+    visitor visit_;
+    thread::pool* pool_{};
+    std::set<std::pair<dev_t, ino_t>> visited_;
+    std::mutex mutex_;
+};
+
+inline void walk(const fs::path& root, const walk_options& options, std::function<void(const walk_entry&)> visit) {
+    walker(options, std::move(visit)).run(root);
+}
+
+inline std::vector<walk_entry> walk(const fs::path& root, const walk_options& options = {}) {
+    std::vector<walk_entry> entries;
+    std::mutex mutex;
+    walk(root, options, [&entries, &mutex](const walk_entry& entry) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.push_back(entry);
+    });
+    return entries;
+}
+
+struct listing_entry {
+    std::string name;
+    bool is_dir{};
+};
+
+using listing_t = std::vector<listing_entry>;
+
+inline listing_t list_directory(const fs::path& dir) {
+    listing_t listing;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        std::error_code error;
+        listing.push_back({ entry.path().filename().generic_string(), entry.is_directory(error) });
+    }
+    return listing;
+}
+
+#if defined(__linux__)
+/*
+    Non-blocking inotify instance with an eventfd to interrupt a waiting read
+*/
+class inotify_t {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+
+public:
+    struct event {
+        int wd{};
+        std::uint32_t mask{};
+        std::uint32_t cookie{};
+        std::string name;
+    };
+
+public:
+    inotify_t() :
+        fd_(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+        wake_fd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+        if (!fd_ || !wake_fd_)
+            throw std::ios_base::failure("Error: Cannot initialize inotify");
+    }
+
+    ~inotify_t() = default;
+
+public:
+    int get() const noexcept { return fd_.get(); }
+
+    int add_watch(path_reference path, std::uint32_t mask) noexcept {
+        return ::inotify_add_watch(fd_.get(), path.c_str(), mask);
+    }
+
+    void remove_watch(int wd) noexcept {
+        ::inotify_rm_watch(fd_.get(), wd);
+    }
+
+    void wake() noexcept {
+        std::uint64_t value{1};
+        [[maybe_unused]] ssize_t result{::write(wake_fd_.get(), &value, sizeof(value))};
+    }
+
+    /*
+        Waits up to timeout_ms (-1 for ever) and appends the pending events.
+        Returns false when interrupted by wake().
+    */
+    bool read(std::vector<event>& out, int timeout_ms = -1) {
+        pollfd fds[2]{ { fd_.get(), POLLIN, 0 }, { wake_fd_.get(), POLLIN, 0 } };
+        int ready{::poll(fds, 2, timeout_ms)};
+        if (ready == -1 && errno != EINTR)
+            throw std::ios_base::failure("Error: Cannot poll inotify");
+
+        if (fds[1].revents & POLLIN) {
+            std::uint64_t value{};
+            [[maybe_unused]] ssize_t result{::read(wake_fd_.get(), &value, sizeof(value))};
+            return false;
+        }
+
+        drain(out);
+        return true;
+    }
+
+    /*
+        Appends whatever events are queued without blocking.
+    */
+    void drain(std::vector<event>& out) {
+        alignas(inotify_event) char buffer[64 * 1024];
+        while (true) {
+            ssize_t count{::read(fd_.get(), buffer, sizeof(buffer))};
+            if (count <= 0)
+                break;
+
+            for (char* ptr{buffer}; ptr < buffer + count;) {
+                auto* item{reinterpret_cast<inotify_event*>(ptr)};
+                out.push_back({ item->wd, item->mask, item->cookie, item->len ? std::string(item->name) : std::string() });
+                ptr += sizeof(inotify_event) + item->len;
+            }
+        }
+    }
+
+private:
+    descriptor fd_;
+    descriptor wake_fd_;
+};
+
+/*
+    LRU cache of directory listings. Every cached directory holds an inotify
+    watch and a background thread drops the listing as soon as the directory
+    changes, so a hit costs no syscalls.
+*/
+class directory_cache {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+    using listing_ptr    = std::shared_ptr<const listing_t>;
+
+    static constexpr std::uint32_t watch_mask{IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                               IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR};
+
+public:
+    explicit directory_cache(size_type capacity = 64) :
+        capacity_(std::max<size_type>(1, capacity))
+    {
+        watcher_ = std::thread([this] { run(); });
+    }
+
+    directory_cache(const directory_cache&) = delete;
+
+    ~directory_cache() {
+        stop_.store(true, std::memory_order_release);
+        inotify_.wake();
+        watcher_.join();
+    }
+
+public:
+    directory_cache& operator=(const directory_cache&) = delete;
+
+public:
+    listing_ptr list(path_reference dir) {
+        std::string key{dir.generic_string()};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it{entries_.find(key)};
+            if (it != entries_.end() && it->second.listing) {
+                lru_.splice(lru_.begin(), lru_, it->second.position);
+                ++hits_;
+                return it->second.listing;
+            }
+            ++misses_;
+        }
+
+        int wd{inotify_.add_watch(dir, watch_mask)};
+        if (wd != -1) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& entry{entries_[key]};
+            if (entry.wd == -1) {
+                entry.wd = wd;
+                entry.position = lru_.insert(lru_.begin(), key);
+            }
+            entry.stale = false;
+            keys_[wd] = key;
+        }
+
+        auto listing{std::make_shared<const listing_t>(list_directory(dir))};
+        if (wd == -1)
+            return listing;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it{entries_.find(key)};
+        if (it != entries_.end() && !it->second.stale) {
+            it->second.listing = listing;
+            evict();
+        }
+        return listing;
+    }
+
+    void invalidate(path_reference dir) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it{entries_.find(dir.generic_string())};
+        if (it != entries_.end())
+            drop(it);
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!entries_.empty())
+            drop(entries_.begin());
+    }
+
+    size_type size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    size_type hits() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return hits_;
+    }
+
+    size_type misses() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return misses_;
+    }
+
+private:
+    struct entry {
+        listing_ptr listing;
+        std::list<std::string>::iterator position;
+        int wd{-1};
+        bool stale{};
+    };
+
+    using entry_iterator = std::unordered_map<std::string, entry>::iterator;
+
+private:
+    void drop(entry_iterator it) {
+        inotify_.remove_watch(it->second.wd);
+        keys_.erase(it->second.wd);
+        lru_.erase(it->second.position);
+        entries_.erase(it);
+    }
+
+    void evict() {
+        while (entries_.size() > capacity_) {
+            auto it{entries_.find(lru_.back())};
+            drop(it);
+        }
+    }
+
+    void run() {
+        std::vector<inotify_t::event> events;
+        while (!stop_.load(std::memory_order_acquire)) {
+            events.clear();
+            if (!inotify_.read(events))
+                continue;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& event : events) {
+                if (event.mask & IN_Q_OVERFLOW) {
+                    for (auto& [key, item] : entries_) {
+                        item.listing.reset();
+                        item.stale = true;
+                    }
+                    continue;
+                }
+
+                auto key{keys_.find(event.wd)};
+                if (key == keys_.end())
+                    continue;
+
+                auto it{entries_.find(key->second)};
+                if (it == entries_.end())
+                    continue;
+
+                if (event.mask & IN_IGNORED) {
+                    keys_.erase(key);
+                    lru_.erase(it->second.position);
+                    entries_.erase(it);
+                } else {
+                    it->second.listing.reset();
+                    it->second.stale = true;
+                }
+            }
+        }
+    }
+
+private:
+    size_type capacity_;
+    inotify_t inotify_;
+    std::unordered_map<std::string, entry> entries_;
+    std::unordered_map<int, std::string> keys_;
+    std::list<std::string> lru_;
+    size_type hits_{};
+    size_type misses_{};
+    std::atomic<bool> stop_{};
+    mutable std::mutex mutex_;
+    std::thread watcher_;
+};
+#endif
+
+/*
+    Metadata fields to request
+*/
+struct stat_mask {
+    static constexpr unsigned type{1};
+    static constexpr unsigned size{2};
+    static constexpr unsigned mtime{4};
+    static constexpr unsigned inode{8};
+    static constexpr unsigned all{type | size | mtime | inode};
+};
+
+struct metadata {
+    fs::file_type type{fs::file_type::not_found};
+    std::uint64_t size{};
+    std::int64_t mtime_ns{};
+    std::uint64_t inode{};
+    std::uint64_t device{};
+    unsigned mask{};
+    std::error_code error;
+
+    bool exists() const noexcept { return type != fs::file_type::not_found && type != fs::file_type::none; }
+
+    bool is_regular() const noexcept { return type == fs::file_type::regular; }
+
+    bool is_directory() const noexcept { return type == fs::file_type::directory; }
+};
+
+/*
+    One statx call asking the kernel only for the fields in mask
+*/
+inline metadata get_metadata(const fs::path& path, unsigned mask = stat_mask::all, bool follow = true) noexcept {
+    metadata info;
+
+    auto to_type{[](mode_t mode) {
+        if (S_ISREG(mode))  return fs::file_type::regular;
+        if (S_ISDIR(mode))  return fs::file_type::directory;
+        if (S_ISLNK(mode))  return fs::file_type::symlink;
+        if (S_ISFIFO(mode)) return fs::file_type::fifo;
+        if (S_ISSOCK(mode)) return fs::file_type::socket;
+        if (S_ISCHR(mode))  return fs::file_type::character;
+        if (S_ISBLK(mode))  return fs::file_type::block;
+        return fs::file_type::unknown;
+    }};
+
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+    unsigned request{};
+    if (mask & stat_mask::type)  request |= STATX_TYPE;
+    if (mask & stat_mask::size)  request |= STATX_SIZE;
+    if (mask & stat_mask::mtime) request |= STATX_MTIME;
+    if (mask & stat_mask::inode) request |= STATX_INO;
+
+    struct ::statx buffer{};
+    int flags{AT_STATX_SYNC_AS_STAT | (follow ? 0 : AT_SYMLINK_NOFOLLOW)};
+    if (::statx(AT_FDCWD, path.c_str(), flags, request, &buffer) == -1) {
+        info.error = std::error_code(errno, std::system_category());
+        return info;
+    }
+
+    info.type = to_type(buffer.stx_mode);
+    info.size = buffer.stx_size;
+    info.mtime_ns = static_cast<std::int64_t>(buffer.stx_mtime.tv_sec) * 1000000000 + buffer.stx_mtime.tv_nsec;
+    info.inode = buffer.stx_ino;
+    info.device = (static_cast<std::uint64_t>(buffer.stx_dev_major) << 32) | buffer.stx_dev_minor;
+#else
+    struct stat buffer{};
+    int result{follow ? ::stat(path.c_str(), &buffer) : ::lstat(path.c_str(), &buffer)};
+    if (result == -1) {
+        info.error = std::error_code(errno, std::system_category());
+        return info;
+    }
+
+    info.type = to_type(buffer.st_mode);
+    info.size = static_cast<std::uint64_t>(buffer.st_size);
+    info.mtime_ns = static_cast<std::int64_t>(buffer.st_mtime) * 1000000000;
+    info.inode = buffer.st_ino;
+    info.device = buffer.st_dev;
+#endif
+
+    info.mask = mask;
+    return info;
+}
+
+/*
+    Key shared by the stat and content caches: the absolute, normal form
+    of the path, so "./a" and "a" name the same entry
+*/
+inline std::string cache_key(const fs::path& path) {
+    std::error_code error;
+    fs::path absolute{fs::absolute(path, error)};
+    return (error ? path : absolute).lexically_normal().generic_string();
+}
+
+/*
+    Metadata cache. Entries live for ttl; with watch enabled an inotify
+    watch on the parent directory also drops them as soon as the file
+    changes, so a hit costs no syscalls. Entries and watched directories
+    use cache_key, so event names always join onto a real directory.
+*/
+class stat_cache {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+    using clock          = std::chrono::steady_clock;
+
+#if defined(__linux__)
+    static constexpr std::uint32_t watch_mask{IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                               IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                                               IN_ONLYDIR};
+#endif
+
+public:
+    explicit stat_cache(std::chrono::milliseconds ttl = std::chrono::milliseconds(1000),
+                        bool watch = false, size_type capacity = 64 * 1024) :
+        ttl_(ttl),
+        capacity_(std::max<size_type>(1, capacity))
+    {
+#if defined(__linux__)
+        if (watch) {
+            inotify_ = std::make_unique<inotify_t>();
+            watcher_ = std::thread([this] { run(); });
+        }
+#else
+        (void)watch;
+#endif
+    }
+
+    stat_cache(const stat_cache&) = delete;
+
+    ~stat_cache() {
+#if defined(__linux__)
+        if (inotify_) {
+            stop_.store(true, std::memory_order_release);
+            inotify_->wake();
+            watcher_.join();
+        }
+#endif
+    }
+
+public:
+    stat_cache& operator=(const stat_cache&) = delete;
+
+public:
+    /*
+        A miss leaves an expired placeholder with a fresh generation while
+        the file is stat'ed; an event, invalidate() or clear() in between
+        removes it, and the result is then returned without being cached.
+    */
+    metadata get(path_reference path, unsigned mask = stat_mask::all) {
+        std::string key{cache_key(path)};
+        auto now{clock::now()};
+        std::uint64_t generation{};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it{entries_.find(key)};
+            if (it != entries_.end() && it->second.expires > now && (it->second.info.mask & mask) == mask) {
+                ++hits_;
+                return it->second.info;
+            }
+            ++misses_;
+
+            if (it == entries_.end()) {
+                if (entries_.size() >= capacity_)
+                    shrink(now);
+                it = entries_.emplace(key, entry{ {}, {}, ++generation_ }).first;
+            }
+            generation = it->second.generation;
+        }
+
+        watch_parent(key);
+        metadata info{get_metadata(path, mask)};
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it{entries_.find(key)};
+        if (it != entries_.end() && it->second.generation == generation) {
+            it->second.info = info;
+            it->second.expires = now + ttl_;
+        }
+        return info;
+    }
+
+    void invalidate(path_reference path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.erase(cache_key(path));
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+    }
+
+    size_type hits() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return hits_;
+    }
+
+    size_type misses() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return misses_;
+    }
+
+private:
+    struct entry {
+        metadata info;
+        clock::time_point expires;
+        std::uint64_t generation{};
+    };
+
+private:
+    void shrink(clock::time_point now) {
+        std::erase_if(entries_, [now](const auto& item) { return item.second.expires <= now; });
+        if (entries_.size() >= capacity_)
+            entries_.clear();
+    }
+
+    void watch_parent([[maybe_unused]] const std::string& key) {
+#if defined(__linux__)
+        if (!inotify_)
+            return;
+
+        std::string dir{fs::path(key).parent_path().generic_string()};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (watched_.count(dir))
+                return;
+        }
+
+        int wd{inotify_->add_watch(fs::path(dir), watch_mask)};
+        if (wd == -1)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        watched_.insert(dir);
+        dirs_[wd] = dir;
+#endif
+    }
+
+#if defined(__linux__)
+    void run() {
+        std::vector<inotify_t::event> events;
+        while (!stop_.load(std::memory_order_acquire)) {
+            events.clear();
+            if (!inotify_->read(events))
+                continue;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& event : events) {
+                if (event.mask & IN_Q_OVERFLOW) {
+                    entries_.clear();
+                    continue;
+                }
+
+                auto dir{dirs_.find(event.wd)};
+                if (dir == dirs_.end())
+                    continue;
+
+                if (event.mask & IN_IGNORED) {
+                    watched_.erase(dir->second);
+                    dirs_.erase(dir);
+                    continue;
+                }
+
+                if (event.name.empty()) {
+                    entries_.erase(dir->second);
+                } else {
+                    entries_.erase((fs::path(dir->second) / event.name).generic_string());
+                }
+            }
+        }
+    }
+#endif
+
+private:
+    std::chrono::milliseconds ttl_;
+    size_type capacity_;
+    std::unordered_map<std::string, entry> entries_;
+    std::uint64_t generation_{};
+    size_type hits_{};
+    size_type misses_{};
+    mutable std::mutex mutex_;
+#if defined(__linux__)
+    std::unique_ptr<inotify_t> inotify_;
+    std::unordered_map<int, std::string> dirs_;
+    std::set<std::string> watched_;
+    std::atomic<bool> stop_{};
+    std::thread watcher_;
+#endif
+};
+
+/*
+    LRU cache of file contents bounded by a byte budget. An entry is valid
+    while the file keeps the size, mtime and inode it was loaded with; hits
+    hand out the shared buffer, so they copy nothing.
+*/
+class content_cache {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+
+public:
+    explicit content_cache(size_type budget = 64 * 1024 * 1024) : budget_(budget) {}
+
+    content_cache(const content_cache&) = delete;
+
+    ~content_cache() = default;
+
+public:
+    content_cache& operator=(const content_cache&) = delete;
+
+public:
+    bool lookup(path_reference path, const metadata& info, shared_buffer& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it{entries_.find(cache_key(path))};
+        if (it == entries_.end()) {
+            ++misses_;
+            return false;
+        }
+
+        const entry& item{it->second};
+        if (item.size != info.size || item.mtime_ns != info.mtime_ns ||
+            item.inode != info.inode || item.device != info.device) {
+            drop(it);
+            ++misses_;
+            return false;
+        }
+
+        lru_.splice(lru_.begin(), lru_, item.position);
+        out = item.buffer;
+        ++hits_;
+        return true;
+    }
+
+    void insert(path_reference path, const metadata& info, shared_buffer buffer) {
+        if (buffer.size() > budget_ || (info.mask & stat_mask::all) != stat_mask::all)
+            return;
+
+        std::string key{cache_key(path)};
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it{entries_.find(key)};
+        if (it != entries_.end())
+            drop(it);
+
+        bytes_ += buffer.size();
+        lru_.push_front(key);
+        entries_[key] = { std::move(buffer), info.size, info.mtime_ns, info.inode, info.device, lru_.begin() };
+
+        while (bytes_ > budget_)
+            drop(entries_.find(lru_.back()));
+    }
+
+    void invalidate(path_reference path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it{entries_.find(cache_key(path))};
+        if (it != entries_.end())
+            drop(it);
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+        lru_.clear();
+        bytes_ = 0;
+    }
+
+    size_type hits() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return hits_;
+    }
+
+    size_type misses() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return misses_;
+    }
+
+    size_type bytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+    size_type budget() const noexcept { return budget_; }
+
+private:
+    struct entry {
+        shared_buffer buffer;
+        std::uint64_t size{};
+        std::int64_t mtime_ns{};
+        std::uint64_t inode{};
+        std::uint64_t device{};
+        std::list<std::string>::iterator position;
+    };
+
+    using entry_iterator = std::unordered_map<std::string, entry>::iterator;
+
+private:
+    void drop(entry_iterator it) {
+        bytes_ -= it->second.buffer.size();
+        lru_.erase(it->second.position);
+        entries_.erase(it);
+    }
+
+private:
+    size_type budget_;
+    size_type bytes_{};
+    size_type hits_{};
+    size_type misses_{};
+    std::unordered_map<std::string, entry> entries_;
+    std::list<std::string> lru_;
+    mutable std::mutex mutex_;
+};
+
+#if defined(__linux__)
+/*
+    LRU cache of open descriptors keyed by absolute path and open flags,
+    so a later chdir does not change what a cached name refers to. Parent
+    directories are held as O_PATH descriptors and files are opened
+    relative to them, so a miss in a known directory skips path walking.
+    An inotify watch per directory evicts a descriptor as soon as its name
+    is renamed, replaced or deleted. Handed out descriptors stay valid
+    after eviction until the last user drops them. Flags that act at open
+    time (O_TRUNC, O_CREAT, O_EXCL, O_TMPFILE) bypass the cache, so every
+    such open reaches the kernel.
+*/
+class descriptor_cache {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+    using handle         = std::shared_ptr<const descriptor>;
+
+    static constexpr std::uint32_t watch_mask{IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                               IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR};
+
+public:
+    explicit descriptor_cache(size_type capacity = 256) :
+        capacity_(std::max<size_type>(1, capacity))
+    {
+        watcher_ = std::thread([this] { run(); });
+    }
+
+    descriptor_cache(const descriptor_cache&) = delete;
+
+    ~descriptor_cache() {
+        stop_.store(true, std::memory_order_release);
+        inotify_.wake();
+        watcher_.join();
+    }
+
+public:
+    descriptor_cache& operator=(const descriptor_cache&) = delete;
+
+public:
+    /*
+        Returns nullptr with errno set when the file cannot be opened
+    */
+    handle open(path_reference path, int flags) {
+        std::error_code error;
+        fs::path absolute{fs::absolute(path, error).lexically_normal()};
+        if (error || acts_on_open(flags)) {
+            int fd{::open(path.c_str(), flags | O_CLOEXEC)};
+            return fd == -1 ? nullptr : std::make_shared<const descriptor>(fd);
+        }
+
+        std::string dir{absolute.parent_path().generic_string()};
+        std::string name{absolute.filename().generic_string()};
+        std::string key{std::to_string(flags) + ":" + absolute.generic_string()};
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it{files_.find(key)};
+        if (it != files_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second.position);
+            ++hits_;
+            return it->second.fd;
+        }
+        ++misses_;
+
+        int dir_fd{directory(dir, lock)};
+        int fd{dir_fd == -1 ? ::open(path.c_str(), flags | O_CLOEXEC) :
+                              ::openat(dir_fd, name.c_str(), flags | O_CLOEXEC)};
+        if (fd == -1) {
+            int saved{errno};
+            if (dir_fd != -1)
+                release_directory(dir);
+            errno = saved;
+            return nullptr;
+        }
+
+        auto result{std::make_shared<const descriptor>(fd)};
+        if (dir_fd == -1)
+            return result;
+
+        if (files_.count(key)) {
+            release_directory(dir);
+            return files_[key].fd;
+        }
+
+        lru_.push_front(key);
+        files_[key] = { result, dir, name, lru_.begin() };
+        while (files_.size() > capacity_)
+            drop(files_.find(lru_.back()));
+        return result;
+    }
+
+    void invalidate(path_reference path) {
+        std::error_code error;
+        fs::path absolute{fs::absolute(path, error).lexically_normal()};
+        std::lock_guard<std::mutex> lock(mutex_);
+        drop_name(absolute.parent_path().generic_string(), absolute.filename().generic_string());
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!files_.empty())
+            drop(files_.begin());
+    }
+
+    size_type size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return files_.size();
+    }
+
+    size_type hits() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return hits_;
+    }
+
+    size_type misses() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return misses_;
+    }
+
+private:
+    struct file_entry {
+        handle fd;
+        std::string dir;
+        std::string name;
+        std::list<std::string>::iterator position;
+    };
+
+    struct dir_entry {
+        descriptor fd;
+        int wd{-1};
+        size_type users{};
+    };
+
+    using file_iterator = std::unordered_map<std::string, file_entry>::iterator;
+
+private:
+    static bool acts_on_open(int flags) noexcept {
+        if (flags & (O_TRUNC | O_CREAT | O_EXCL))
+            return true;
+#if defined(O_TMPFILE)
+        return (flags & O_TMPFILE) == O_TMPFILE;
+#else
+        return false;
+#endif
+    }
+
+    int directory(const std::string& dir, std::unique_lock<std::mutex>& lock) {
+        auto it{dirs_.find(dir)};
+        if (it != dirs_.end()) {
+            ++it->second.users;
+            return it->second.fd.get();
+        }
+
+        lock.unlock();
+        fs::path dir_path{dir.empty() ? fs::path(".") : fs::path(dir)};
+        descriptor fd(::open(dir_path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC));
+        int wd{fd ? inotify_.add_watch(dir_path, watch_mask) : -1};
+        lock.lock();
+
+        if (wd == -1)
+            return -1;
+
+        auto& entry{dirs_[dir]};
+        if (!entry.fd) {
+            entry.fd = std::move(fd);
+            entry.wd = wd;
+            watches_[wd] = dir;
+        }
+        ++entry.users;
+        return entry.fd.get();
+    }
+
+    void release_directory(const std::string& dir) {
+        auto it{dirs_.find(dir)};
+        if (it == dirs_.end() || --it->second.users)
+            return;
+        inotify_.remove_watch(it->second.wd);
+        watches_.erase(it->second.wd);
+        dirs_.erase(it);
+    }
+
+    void drop(file_iterator it) {
+        std::string dir{std::move(it->second.dir)};
+        lru_.erase(it->second.position);
+        files_.erase(it);
+        release_directory(dir);
+    }
+
+    void drop_name(const std::string& dir, const std::string& name) {
+        for (auto it{files_.begin()}; it != files_.end();) {
+            auto next{std::next(it)};
+            if (it->second.dir == dir && (name.empty() || it->second.name == name))
+                drop(it);
+            it = next;
+        }
+    }
+
+    void run() {
+        std::vector<inotify_t::event> events;
+        while (!stop_.load(std::memory_order_acquire)) {
+            events.clear();
+            if (!inotify_.read(events))
+                continue;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& event : events) {
+                if (event.mask & IN_Q_OVERFLOW) {
+                    while (!files_.empty())
+                        drop(files_.begin());
+                    continue;
+                }
+
+                auto dir{watches_.find(event.wd)};
+                if (dir == watches_.end())
+                    continue;
+
+                std::string dir_name{dir->second};
+                if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                    drop_name(dir_name, std::string());
+                } else {
+                    drop_name(dir_name, event.name);
+                }
+            }
+        }
+    }
+
+private:
+    size_type capacity_;
+    inotify_t inotify_;
+    std::unordered_map<std::string, file_entry> files_;
+    std::unordered_map<std::string, dir_entry> dirs_;
+    std::unordered_map<int, std::string> watches_;
+    std::list<std::string> lru_;
+    size_type hits_{};
+    size_type misses_{};
+    std::atomic<bool> stop_{};
+    mutable std::mutex mutex_;
+    std::thread watcher_;
+};
+#endif
+
+#if defined(__linux__)
+struct change_kind {
+    static constexpr unsigned created    = 1;
+    static constexpr unsigned modified   = 2;
+    static constexpr unsigned removed    = 4;
+    static constexpr unsigned attributes = 8;
+    static constexpr unsigned rescan     = 16;
+};
+
+struct change {
+    fs::path path;
+    unsigned kinds{};
+    bool is_dir{};
+};
+
+using change_set = std::vector<change>;
+
+struct watch_options {
+    bool recursive{true};
+    std::chrono::milliseconds debounce{50};
+    std::chrono::milliseconds max_latency{500};
+};
+
+/*
+    Event-driven monitor for files and directory trees. Raw inotify events
+    are coalesced per path until the watched set has been quiet for the
+    debounce window (or max_latency has passed since the first event) and
+    are then delivered as one sorted change set, either to the callback on
+    the watcher thread or to a queue drained with next(). A kernel queue
+    overflow is reported as a rescan of every root. watch_mount() adds
+    fanotify monitoring of a whole mount where the process is permitted.
+*/
+class watcher {
+private:
+    using path_reference = const fs::path&;
+    using clock          = std::chrono::steady_clock;
+    using callback_type  = std::function<void(const change_set&)>;
+
+    static constexpr std::uint32_t watch_mask{IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                                               IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF};
+
+    struct pending_change {
+        unsigned kinds{};
+        unsigned first{};
+        unsigned last{};
+        bool is_dir{};
+    };
+
+public:
+    explicit watcher(watch_options options = {}) :
+        watcher(callback_type(), options)
+    {}
+
+    explicit watcher(callback_type callback, watch_options options = {}) :
+        options_(options),
+        callback_(std::move(callback)),
+        wake_fd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+        if (!wake_fd_)
+            throw std::ios_base::failure("Error: Cannot initialize watcher");
+        thread_ = std::thread([this] { run(); });
+    }
+
+    watcher(const watcher&) = delete;
+
+    ~watcher() {
+        stop_.store(true, std::memory_order_release);
+        wake();
+        thread_.join();
+    }
+
+public:
+    watcher& operator=(const watcher&) = delete;
+
+public:
+    /*
+        Watches a file or, recursively unless disabled, a directory
+    */
+    void add(path_reference path) {
+        fs::path root{normalize(path)};
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!watch_tree(root, false))
+            throw std::ios_base::failure("Error: Cannot watch path: " + path.string());
+        roots_.insert(root.string());
+    }
+
+    void remove(path_reference path) {
+        fs::path root{normalize(path)};
+        std::lock_guard<std::mutex> lock(mutex_);
+        roots_.erase(root.string());
+        unwatch_tree(root.string());
+    }
+
+    /*
+        Reports modifications anywhere on the mount holding path. Needs
+        CAP_SYS_ADMIN; returns false when fanotify is unavailable.
+    */
+    bool watch_mount(path_reference path) {
+#if __has_include(<sys/fanotify.h>)
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!fanotify_) {
+            fanotify_ = descriptor(::fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK,
+                                                   O_RDONLY | O_LARGEFILE | O_CLOEXEC));
+            if (!fanotify_)
+                return false;
+        }
+        if (::fanotify_mark(fanotify_.get(), FAN_MARK_ADD | FAN_MARK_MOUNT,
+                            FAN_MODIFY | FAN_CLOSE_WRITE, AT_FDCWD, path.c_str()) == -1)
+            return false;
+
+        mounts_.insert(normalize(path).string());
+        wake();
+        return true;
+#else
+        static_cast<void>(path);
+        return false;
+#endif
+    }
+
+    /*
+        Queue mode only: waits up to timeout for the next change set
+    */
+    bool next(change_set& out, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        if (!queue_cv_.wait_for(lock, timeout, [this] { return !queue_.empty(); }))
+            return false;
+
+        out = std::move(queue_.front());
+        queue_.pop_front();
+        return true;
+    }
+
+private:
+    static fs::path normalize(path_reference path) {
+        std::error_code ec;
+        fs::path result{fs::absolute(path, ec).lexically_normal()};
+        if (!result.has_filename() && result.has_parent_path() && result != result.root_path())
+            result = result.parent_path();
+        return result;
+    }
+
+    void wake() noexcept {
+        std::uint64_t value{1};
+        [[maybe_unused]] ssize_t result{::write(wake_fd_.get(), &value, sizeof(value))};
+    }
+
+    /*
+        Caller holds mutex_. New directories are reported with their
+        content, since files may land in them before the watch exists.
+    */
+    bool watch_tree(path_reference path, bool report) {
+        int wd{inotify_.add_watch(path, watch_mask)};
+        if (wd == -1)
+            return false;
+        watches_[wd] = path.string();
+
+        std::error_code ec;
+        if (!options_.recursive || !fs::is_directory(path, ec))
+            return true;
+
+        fs::recursive_directory_iterator it(path, fs::directory_options::skip_permission_denied, ec);
+        for (fs::recursive_directory_iterator end; !ec && it != end; it.increment(ec)) {
+            std::error_code type_ec;
+            bool is_dir{it->is_directory(type_ec) && !it->is_symlink(type_ec)};
+            if (report)
+                record(it->path(), change_kind::created, is_dir);
+            if (is_dir) {
+                int sub{inotify_.add_watch(it->path(), watch_mask)};
+                if (sub != -1)
+                    watches_[sub] = it->path().string();
+            }
+        }
+        return true;
+    }
+
+    void unwatch_tree(const std::string& path) {
+        for (auto it{watches_.begin()}; it != watches_.end();) {
+            const std::string& name{it->second};
+            if (name == path || (name.size() > path.size() && name.compare(0, path.size(), path) == 0 &&
+                                 name[path.size()] == '/')) {
+                inotify_.remove_watch(it->first);
+                it = watches_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void record(path_reference path, unsigned kind, bool is_dir) {
+        auto now{clock::now()};
+        if (pending_.empty())
+            first_event_ = now;
+        last_event_ = now;
+
+        pending_change& item{pending_[path.string()]};
+        if (!item.first)
+            item.first = kind;
+        item.last = kind;
+        item.kinds |= kind;
+        item.is_dir = item.is_dir || is_dir;
+    }
+
+    void rescan() {
+        pending_.clear();
+        for (const std::string& root : roots_) {
+            std::error_code ec;
+            record(root, change_kind::rescan, fs::is_directory(root, ec));
+            watch_tree(root, false);
+        }
+        for (const std::string& mount : mounts_)
+            record(mount, change_kind::rescan, true);
+    }
+
+    void handle(const std::vector<inotify_t::event>& events) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const inotify_t::event& event : events) {
+            if (event.mask & IN_Q_OVERFLOW) {
+                rescan();
+                continue;
+            }
+
+            auto it{watches_.find(event.wd)};
+            if (it == watches_.end())
+                continue;
+            if (event.mask & IN_IGNORED) {
+                watches_.erase(it);
+                continue;
+            }
+
+            fs::path path{event.name.empty() ? fs::path(it->second) : fs::path(it->second) / event.name};
+            bool is_dir{(event.mask & IN_ISDIR) != 0};
+            if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                if (roots_.count(it->second))
+                    record(path, change_kind::removed, is_dir);
+                continue;
+            }
+
+            unsigned kind{change_kind::attributes};
+            if (event.mask & (IN_CREATE | IN_MOVED_TO))
+                kind = change_kind::created;
+            else if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+                kind = change_kind::removed;
+            else if (event.mask & (IN_MODIFY | IN_CLOSE_WRITE))
+                kind = change_kind::modified;
+            record(path, kind, is_dir);
+
+            if (is_dir && options_.recursive) {
+                if (event.mask & IN_MOVED_FROM)
+                    unwatch_tree(path.string());
+                else if (kind == change_kind::created)
+                    watch_tree(path, true);
+            }
+        }
+    }
+
+#if __has_include(<sys/fanotify.h>)
+    void handle_fanotify(int fd) {
+        alignas(fanotify_event_metadata) char buffer[16 * 1024];
+        while (true) {
+            ssize_t count{::read(fd, buffer, sizeof(buffer))};
+            if (count <= 0)
+                break;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto* item{reinterpret_cast<fanotify_event_metadata*>(buffer)};
+            for (; FAN_EVENT_OK(item, count); item = FAN_EVENT_NEXT(item, count)) {
+                if (item->mask & FAN_Q_OVERFLOW) {
+                    rescan();
+                    continue;
+                }
+                if (item->fd < 0)
+                    continue;
+
+                descriptor file(item->fd);
+                char name[4096];
+                std::string link{"/proc/self/fd/" + std::to_string(file.get())};
+                ssize_t length{::readlink(link.c_str(), name, sizeof(name))};
+                if (length > 0)
+                    record(fs::path(std::string(name, static_cast<std::size_t>(length))), change_kind::modified, false);
+            }
+        }
+    }
+#endif
+
+    /*
+        Collapses each path to its net effect: created then removed
+        vanishes, removed then recreated is a modification.
+    */
+    void flush() {
+        change_set batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            batch.reserve(pending_.size());
+            for (const auto& [path, item] : pending_) {
+                unsigned kinds{item.kinds};
+                if (kinds & change_kind::rescan)
+                    kinds = change_kind::rescan;
+                else if (item.first == change_kind::created && item.last == change_kind::removed)
+                    continue;
+                else if (item.last == change_kind::removed)
+                    kinds = change_kind::removed;
+                else if (item.first == change_kind::created)
+                    kinds = change_kind::created;
+                else if (item.first == change_kind::removed)
+                    kinds = change_kind::modified;
+                batch.push_back({ path, kinds, item.is_dir });
+            }
+            pending_.clear();
+        }
+        if (batch.empty())
+            return;
+
+        if (callback_) {
+            try {
+                callback_(batch);
+            } catch (...) {
+                // A failing callback must not take the watcher thread down
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            queue_.push_back(std::move(batch));
+        }
+        queue_cv_.notify_one();
+    }
+
+    void run() {
+        std::vector<inotify_t::event> events;
+        while (!stop_.load(std::memory_order_acquire)) {
+            int timeout{-1};
+            bool waiting{};
+            int fanotify_fd{-1};
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                waiting = !pending_.empty();
+                if (waiting) {
+                    auto deadline{std::min(last_event_ + options_.debounce, first_event_ + options_.max_latency)};
+                    auto left{std::chrono::ceil<std::chrono::milliseconds>(deadline - clock::now())};
+                    timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(0, left.count()));
+                }
+                fanotify_fd = fanotify_.get();
+            }
+
+            pollfd fds[3]{ { inotify_.get(), POLLIN, 0 }, { wake_fd_.get(), POLLIN, 0 }, { fanotify_fd, POLLIN, 0 } };
+            int ready{::poll(fds, 3, timeout)};
+            if (ready == -1 && errno != EINTR)
+                break;
+
+            if (ready > 0 && (fds[1].revents & POLLIN)) {
+                std::uint64_t value{};
+                [[maybe_unused]] ssize_t result{::read(wake_fd_.get(), &value, sizeof(value))};
+            }
+            if (ready > 0 && (fds[0].revents & POLLIN)) {
+                events.clear();
+                inotify_.drain(events);
+                handle(events);
+            }
+#if __has_include(<sys/fanotify.h>)
+            if (ready > 0 && (fds[2].revents & POLLIN))
+                handle_fanotify(fanotify_fd);
+#endif
+            if (waiting && due())
+                flush();
+        }
+    }
+
+    bool due() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto deadline{std::min(last_event_ + options_.debounce, first_event_ + options_.max_latency)};
+        return !pending_.empty() && clock::now() >= deadline;
+    }
+
+private:
+    watch_options options_;
+    callback_type callback_;
+    inotify_t inotify_;
+    descriptor wake_fd_;
+    descriptor fanotify_;
+    std::unordered_map<int, std::string> watches_;
+    std::set<std::string> roots_;
+    std::set<std::string> mounts_;
+    std::map<std::string, pending_change> pending_;
+    clock::time_point first_event_;
+    clock::time_point last_event_;
+    std::deque<change_set> queue_;
+    std::atomic<bool> stop_{};
+    mutable std::mutex mutex_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::thread thread_;
+};
+#endif
+
+#if defined(__linux__)
+/*
+    Follows a growing file like tail -F. Only bytes past the last offset
+    are read, with pread into one reusable buffer, after inotify reports a
+    change. Truncation restarts from offset zero; when the path is rotated
+    to a new inode the old file is drained first and a trailing partial
+    line is delivered on its own. Lines are views into the buffer and stay
+    valid until the next call. Events for other names in the directory are
+    drained without waking the reader.
+*/
+class follower {
+private:
+    using size_type      = std::size_t;
+    using path_reference = const fs::path&;
+    using clock          = std::chrono::steady_clock;
+
+    static constexpr std::uint32_t file_mask{IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF};
+    static constexpr std::uint32_t dir_mask{IN_CREATE | IN_MOVED_TO | IN_ONLYDIR};
+
+public:
+    explicit follower(path_reference path, bool from_start = false, size_type buffer_size = 64 * 1024) :
+        path_(path),
+        name_(path.filename().string()),
+        buffer_(std::max<size_type>(buffer_size, 4096), '\0')
+    {
+        if (!open_current())
+            throw std::ios_base::failure("Error: Cannot open file: " + path.string());
+
+        struct stat info{};
+        if (!from_start && ::fstat(fd_.get(), &info) == 0)
+            offset_ = static_cast<size_type>(info.st_size);
+
+        fs::path dir{path_.parent_path()};
+        dir_wd_ = inotify_.add_watch(dir.empty() ? fs::path(".") : dir, dir_mask);
+    }
+
+    follower(const follower&) = delete;
+
+    ~follower() = default;
+
+public:
+    follower& operator=(const follower&) = delete;
+
+public:
+    /*
+        Waits up to timeout_ms (-1 for ever) for the next complete line.
+        Returns false on timeout or after stop().
+    */
+    bool next_line(std::string_view& line, int timeout_ms = -1) {
+        auto deadline{clock::now() + std::chrono::milliseconds(std::max(timeout_ms, 0))};
+        while (!stopped_.load(std::memory_order_acquire)) {
+            if (take_line(line))
+                return true;
+            if (refill())
+                continue;
+
+            do {
+                int wait{-1};
+                if (timeout_ms >= 0) {
+                    auto left{std::chrono::ceil<std::chrono::milliseconds>(deadline - clock::now())};
+                    if (left.count() <= 0)
+                        return false;
+                    wait = static_cast<int>(left.count());
+                }
+
+                events_.clear();
+                if (!inotify_.read(events_, wait))
+                    return false;
+            } while (!stopped_.load(std::memory_order_acquire) && !relevant());
+        }
+        return false;
+    }
+
+    /*
+        Waits like next_line() and then hands every available line to visit
+    */
+    template <typename Visitor>
+    size_type poll(Visitor&& visit, int timeout_ms = -1) {
+        std::string_view line;
+        if (!next_line(line, timeout_ms))
+            return 0;
+
+        size_type count{};
+        do {
+            visit(line);
+            ++count;
+        } while (next_line(line, 0));
+        return count;
+    }
+
+    /*
+        Offset in the current file of the first byte not yet returned. After
+        a rotation the lines still pending from the old file are not counted.
+    */
+    size_type offset() const noexcept { return offset_ - (end_ - std::max(begin_, boundary_)); }
+
+    const fs::path& path() const noexcept { return path_; }
+
+    void stop() noexcept {
+        stopped_.store(true, std::memory_order_release);
+        inotify_.wake();
+    }
+
+private:
+    bool open_current() {
+        descriptor fd(::open(path_.c_str(), O_RDONLY | O_CLOEXEC));
+        struct stat info{};
+        if (!fd || ::fstat(fd.get(), &info) == -1)
+            return false;
+
+        if (file_wd_ != -1)
+            inotify_.remove_watch(file_wd_);
+        file_wd_ = inotify_.add_watch(path_, file_mask);
+        device_ = info.st_dev;
+        inode_ = info.st_ino;
+        fd_ = std::move(fd);
+        return true;
+    }
+
+    bool relevant() const noexcept {
+        for (const auto& event : events_) {
+            if (event.wd != dir_wd_ || event.name == name_)
+                return true;
+        }
+        return false;
+    }
+
+    bool rotated() const noexcept {
+        struct stat info{};
+        return ::stat(path_.c_str(), &info) == 0 && (info.st_ino != inode_ || info.st_dev != device_);
+    }
+
+    bool take_line(std::string_view& line) noexcept {
+        size_type limit{boundary_ > begin_ ? boundary_ : end_};
+        const char* base{buffer_.data()};
+        const void* hit{scan_ < limit ? std::memchr(base + scan_, '\n', limit - scan_) : nullptr};
+        if (hit) {
+            size_type position{static_cast<size_type>(static_cast<const char*>(hit) - base)};
+            line = std::string_view(base + begin_, position - begin_);
+            begin_ = scan_ = position + 1;
+            return true;
+        }
+        if (boundary_ > begin_) {
+            line = std::string_view(base + begin_, boundary_ - begin_);
+            begin_ = scan_ = boundary_;
+            return true;
+        }
+        scan_ = end_;
+        return false;
+    }
+
+    /*
+        Moves the unfinished line to the front, growing the buffer only
+        when that line alone fills it.
+    */
+    void make_room() {
+        if (end_ < buffer_.size())
+            return;
+        if (begin_ == 0) {
+            buffer_.resize(buffer_.size() * 2);
+            return;
+        }
+
+        std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        scan_ -= begin_;
+        boundary_ = boundary_ > begin_ ? boundary_ - begin_ : 0;
+        begin_ = 0;
+    }
+
+    /*
+        Returns true when new data or a rotation boundary became available
+    */
+    bool refill() {
+        while (true) {
+            struct stat info{};
+            if (::fstat(fd_.get(), &info) == 0 && static_cast<size_type>(info.st_size) < offset_) {
+                offset_ = 0;
+                begin_ = scan_ = end_ = boundary_ = 0;
+            }
+
+            make_room();
+            ssize_t count{};
+            do {
+                count = ::pread(fd_.get(), buffer_.data() + end_, buffer_.size() - end_, static_cast<off_t>(offset_));
+            } while (count == -1 && errno == EINTR);
+
+            if (count > 0) {
+                end_ += static_cast<size_type>(count);
+                offset_ += static_cast<size_type>(count);
+                return true;
+            }
+
+            if (!rotated() || !open_current())
+                return false;
+
+            offset_ = 0;
+            boundary_ = end_;
+            if (boundary_ > begin_)
+                return true;
+        }
+    }
+
+private:
+    fs::path path_;
+    std::string name_;
+    std::string buffer_;
+    inotify_t inotify_;
+    descriptor fd_;
+    int file_wd_{-1};
+    int dir_wd_{-1};
+    dev_t device_{};
+    ino_t inode_{};
+    size_type offset_{};
+    size_type begin_{};
+    size_type scan_{};
+    size_type end_{};
+    size_type boundary_{};
+    std::vector<inotify_t::event> events_;
+    std::atomic<bool> stopped_{};
+};
+#endif
+
+struct duplicate_options {
+    std::uint64_t min_size{1};
+    std::size_t probe_size{4096};
+    bool verify{};
+    std::size_t threads{};
+    walk_options walk;
+};
+
+struct duplicate_group {
+    std::uint64_t size{};
+    std::vector<fs::path> paths;
+};
+
+/*
+    Duplicate search in stages that each shrink the candidate set: equal
+    sizes, then a hash of the first and last probe_size bytes, then a hash
+    of the whole content, and optionally a byte compare of mapped files.
+    Hard links count as one file. At most threads files are read at once,
+    and candidates are kept as packed records with their paths in one
+    shared string, so memory stays near the total path length.
+*/
+class duplicate_finder {
+private:
+    using size_type = std::size_t;
+
+    struct candidate {
+        std::uint64_t size{};
+        std::uint64_t device{};
+        std::uint64_t inode{};
+        size_type offset{};
+        size_type length{};
+        hash::hash128 key{};
+        bool failed{};
+    };
+
+    static constexpr size_type batch_size{64};
+    static constexpr size_type read_size{256 * 1024};
+
+public:
+    explicit duplicate_finder(const duplicate_options& options) :
+        options_(options),
+        threads_(options.threads ? options.threads : std::max<size_type>(1, std::thread::hardware_concurrency()))
+    {}
+
+public:
+    std::vector<duplicate_group> run(const fs::path& root) {
+        collect(root);
+
+        std::string_view names{names_};
+        std::sort(candidates_.begin(), candidates_.end(), [names](const candidate& lhs, const candidate& rhs) {
+            if (lhs.size != rhs.size || lhs.device != rhs.device || lhs.inode != rhs.inode)
+                return std::tie(lhs.size, lhs.device, lhs.inode) < std::tie(rhs.size, rhs.device, rhs.inode);
+            return names.substr(lhs.offset, lhs.length) < names.substr(rhs.offset, rhs.length);
+        });
+        candidates_.erase(std::unique(candidates_.begin(), candidates_.end(), [](const candidate& lhs, const candidate& rhs) {
+            return lhs.size == rhs.size && lhs.device == rhs.device && lhs.inode == rhs.inode;
+        }), candidates_.end());
+        keep_collisions();
+
+        hash_all([](const candidate&) { return true; }, false);
+        keep_collisions();
+
+        hash_all([this](const candidate& item) { return item.size > 2 * options_.probe_size; }, true);
+        keep_collisions();
+
+        std::vector<duplicate_group> groups;
+        for (size_type begin{}, end{}; begin < candidates_.size(); begin = end) {
+            for (end = begin + 1; end < candidates_.size() && same(candidates_[begin], candidates_[end]);)
+                ++end;
+
+            duplicate_group group{candidates_[begin].size, {}};
+            for (size_type i{begin}; i < end; ++i)
+                group.paths.push_back(path_of(candidates_[i]));
+            groups.push_back(std::move(group));
+        }
+        candidates_ = {};
+        names_ = {};
+
+        if (options_.verify)
+            groups = verify(std::move(groups));
+
+        for (duplicate_group& group : groups)
+            std::sort(group.paths.begin(), group.paths.end());
+        std::sort(groups.begin(), groups.end(), [](const duplicate_group& lhs, const duplicate_group& rhs) {
+            return lhs.size != rhs.size ? lhs.size > rhs.size : lhs.paths.front() < rhs.paths.front();
+        });
+        return groups;
+    }
+
+private:
+    static bool same(const candidate& lhs, const candidate& rhs) noexcept {
+        return lhs.size == rhs.size && lhs.key == rhs.key;
+    }
+
+    fs::path path_of(const candidate& item) const {
+        return fs::path(names_.substr(item.offset, item.length));
+    }
+
+    void report(const fs::path& path, std::error_code error) const {
+        if (options_.walk.on_error)
+            options_.walk.on_error(path, error);
+    }
+
+    void collect(const fs::path& root) {
+        walk(root, options_.walk, [this](const walk_entry& entry) {
+            if (entry.type != fs::file_type::regular)
+                return;
+
+            metadata info{get_metadata(entry.path, stat_mask::size | stat_mask::inode, false)};
+            if (info.error) {
+                report(entry.path, info.error);
+                return;
+            }
+            if (info.size < options_.min_size)
+                return;
+
+            const std::string& name{entry.path.native()};
+            std::lock_guard<std::mutex> lock(mutex_);
+            candidates_.push_back({ info.size, info.device, info.inode, names_.size(), name.size() });
+            names_ += name;
+        });
+    }
+
+    /*
+        Sorts by (size, key) and keeps only readable candidates that still
+        share both with another one
+    */
+    void keep_collisions() {
+        std::sort(candidates_.begin(), candidates_.end(), [](const candidate& lhs, const candidate& rhs) {
+            return std::tie(lhs.size, lhs.key.low, lhs.key.high) < std::tie(rhs.size, rhs.key.low, rhs.key.high);
+        });
+
+        size_type kept{};
+        for (size_type begin{}, end{}; begin < candidates_.size(); begin = end) {
+            for (end = begin + 1; end < candidates_.size() && same(candidates_[begin], candidates_[end]);)
+                ++end;
+
+            size_type readable{};
+            for (size_type i{begin}; i < end; ++i)
+                readable += !candidates_[i].failed;
+            if (readable < 2)
+                continue;
+
+            for (size_type i{begin}; i < end; ++i) {
+                if (!candidates_[i].failed)
+                    candidates_[kept++] = candidates_[i];
+            }
+        }
+        candidates_.resize(kept);
+        candidates_.shrink_to_fit();
+    }
+
+    template <typename Predicate>
+    void hash_all(Predicate selected, bool full) {
+        thread::pool workers(threads_);
+        for (size_type begin{}; begin < candidates_.size(); begin += batch_size) {
+            workers.submit([this, &selected, begin, full] {
+                size_type end{std::min(begin + batch_size, candidates_.size())};
+                for (size_type i{begin}; i < end; ++i) {
+                    if (selected(candidates_[i]))
+                        hash_one(candidates_[i], full);
+                }
+            });
+        }
+        workers.wait();
+    }
+
+    /*
+        Files up to twice the probe size are hashed whole in the probe pass
+    */
+    void hash_one(candidate& item, bool full) const {
+        static thread_local std::unique_ptr<char[]> buffer(new char[read_size]);
+
+        fs::path path{path_of(item)};
+        descriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (!fd) {
+            item.failed = true;
+            report(path, std::error_code(errno, std::system_category()));
+            return;
+        }
+
+        hash::fast_hash state;
+        std::error_code error;
+        std::uint64_t expected{};
+        std::uint64_t done{};
+        if (!full && item.size > 2 * options_.probe_size) {
+            for (std::uint64_t offset : { std::uint64_t{}, item.size - options_.probe_size }) {
+                for (std::uint64_t part{}; part < options_.probe_size && !error;) {
+                    size_type want{static_cast<size_type>(std::min<std::uint64_t>(read_size, options_.probe_size - part))};
+                    size_type count{pread_full(fd.get(), buffer.get(), want, static_cast<off_t>(offset + part), error)};
+                    state.update(buffer.get(), count);
+                    done += count;
+                    part += want;
+                }
+            }
+            expected = 2 * options_.probe_size;
+        } else {
+            ::posix_fadvise(fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+            while (done < item.size && !error) {
+                size_type want{static_cast<size_type>(std::min<std::uint64_t>(read_size, item.size - done))};
+                size_type count{pread_full(fd.get(), buffer.get(), want, static_cast<off_t>(done), error)};
+                state.update(buffer.get(), count);
+                done += count;
+                if (count < want)
+                    break;
+            }
+            expected = item.size;
+        }
+
+        if (error || done != expected) {
+            item.failed = true;
+            report(path, error ? error : std::make_error_code(std::errc::io_error));
+            return;
+        }
+        item.key = state.digest();
+    }
+
+    /*
+        Splits every group into classes of byte-identical mappings
+    */
+    std::vector<duplicate_group> verify(std::vector<duplicate_group> groups) const {
+        std::vector<std::vector<duplicate_group>> verified(groups.size());
+        {
+            thread::pool workers(threads_);
+            for (size_type i{}; i < groups.size(); ++i) {
+                if (!groups[i].size) {
+                    verified[i].push_back(std::move(groups[i]));
+                    continue;
+                }
+
+                workers.submit([this, &groups, &verified, i] {
+                    std::vector<mapped_region> representatives;
+                    std::vector<duplicate_group> classes;
+                    for (fs::path& path : groups[i].paths) {
+                        try {
+                            mapped_region region(path);
+                            region.advise(mapped_region::advice::sequential);
+                            size_type match{};
+                            while (match < representatives.size() &&
+                                   (representatives[match].size() != region.size() ||
+                                    std::memcmp(representatives[match].data(), region.data(), region.size()) != 0))
+                                ++match;
+
+                            if (match == representatives.size()) {
+                                representatives.push_back(std::move(region));
+                                classes.push_back({ groups[i].size, {} });
+                            }
+                            classes[match].paths.push_back(std::move(path));
+                        } catch (const std::exception&) {
+                            report(path, std::make_error_code(std::errc::io_error));
+                        }
+                    }
+                    for (duplicate_group& item : classes) {
+                        if (item.paths.size() > 1)
+                            verified[i].push_back(std::move(item));
+                    }
+                });
+            }
+            workers.wait();
+        }
+
+        std::vector<duplicate_group> result;
+        for (std::vector<duplicate_group>& classes : verified)
+            std::move(classes.begin(), classes.end(), std::back_inserter(result));
+        return result;
+    }
+
+private:
+    const duplicate_options& options_;
+    size_type threads_;
+    std::vector<candidate> candidates_;
+    std::string names_;
+    std::mutex mutex_;
+};
+
+inline std::vector<duplicate_group> find_duplicates(const fs::path& root, const duplicate_options& options = {}) {
+    return duplicate_finder(options).run(root);
+}
+
+struct search_match {
+    std::size_t offset{};
+    std::size_t line{};
+    std::size_t pattern{};
+};
+
+struct file_matches {
+    fs::path path;
+    std::vector<search_match> matches;
+    std::error_code error;
+};
+
+/*
+    Compiled set of byte patterns. A single pattern is found with the SIMD
+    first/last byte filter: blocks of 32 positions are tested against both
+    end bytes at once and only survivors are compared in full. Several
+    patterns run through an Aho-Corasick automaton with a dense transition
+    table over byte classes: every byte that occurs in a pattern has its
+    own column and all other bytes share one. Overlapping matches are all reported, sorted by offset, with
+    1-based line numbers.
+*/
+class searcher {
+private:
+    using size_type = std::size_t;
+
+    static constexpr std::int32_t none{-1};
+
+public:
+    explicit searcher(std::string_view pattern) :
+        searcher(std::vector<std::string>{ std::string(pattern) })
+    {}
+
+    explicit searcher(std::vector<std::string> patterns) :
+        patterns_(std::move(patterns))
+    {
+        if (patterns_.empty())
+            throw std::invalid_argument("Incorrect argument");
+
+        for (const std::string& pattern : patterns_) {
+            if (pattern.empty())
+                throw std::invalid_argument("Incorrect argument");
+            max_length_ = std::max(max_length_, pattern.size());
+        }
+
+        if (patterns_.size() > 1)
+            build();
+    }
+
+public:
+    size_type size() const noexcept { return patterns_.size(); }
+
+    const std::string& pattern(size_type index) const { return patterns_.at(index); }
+
+    std::vector<search_match> find(std::string_view text) const {
+        std::vector<search_match> matches;
+        scan(text, matches);
+        number_lines(text, matches, 1);
+        return matches;
+    }
+
+    /*
+        Consumes the chunks not read yet. Each chunk is searched in
+        place; only the last max_length - 1 bytes before it are copied
+        and searched together with its head, so a match that spans two
+        chunks is found exactly once.
+    */
+    std::vector<search_match> find(stream_t& stream) const {
+        std::vector<search_match> result;
+        std::vector<search_match> matches;
+        std::string tail;
+        std::string joint;
+        size_type base{};
+        size_type line{1};
+
+        for (std::string_view chunk; stream.next(chunk);) {
+            if (!tail.empty()) {
+                joint.assign(tail);
+                joint.append(chunk.substr(0, max_length_ - 1));
+
+                matches.clear();
+                scan(joint, matches);
+                std::erase_if(matches, [this, &tail](const search_match& match) {
+                    return match.offset >= tail.size() || match.offset + patterns_[match.pattern].size() <= tail.size();
+                });
+                number_lines(joint, matches, line - simd::count_byte(tail.data(), tail.size(), '\n'));
+                for (search_match& match : matches) {
+                    match.offset += base - tail.size();
+                    result.push_back(match);
+                }
+            }
+
+            matches.clear();
+            scan(chunk, matches);
+            number_lines(chunk, matches, line);
+            for (search_match& match : matches) {
+                match.offset += base;
+                result.push_back(match);
+            }
+
+            line += simd::count_byte(chunk.data(), chunk.size(), '\n');
+            base += chunk.size();
+            if (chunk.size() >= max_length_ - 1) {
+                tail.assign(chunk.substr(chunk.size() - (max_length_ - 1)));
+            } else {
+                tail.append(chunk);
+                tail.erase(0, tail.size() - std::min(tail.size(), max_length_ - 1));
+            }
+        }
+
+        std::sort(result.begin(), result.end(), [](const search_match& lhs, const search_match& rhs) {
+            return lhs.offset != rhs.offset ? lhs.offset < rhs.offset : lhs.pattern < rhs.pattern;
+        });
+        return result;
+    }
+
+private:
+    void build() {
+        for (const std::string& pattern : patterns_) {
+            for (unsigned char byte : pattern)
+                classes_[byte] = 1;
+        }
+        alphabet_ = 1;
+        for (std::uint16_t& slot : classes_)
+            slot = slot ? static_cast<std::uint16_t>(alphabet_++) : 0;
+
+        next_.assign(alphabet_, none);
+        terminal_.assign(1, none);
+        duplicate_.assign(patterns_.size(), none);
+
+        for (size_type index{}; index < patterns_.size(); ++index) {
+            std::int32_t state{};
+            for (unsigned char byte : patterns_[index]) {
+                size_type slot{static_cast<size_type>(state) * alphabet_ + classes_[byte]};
+                if (next_[slot] == none) {
+                    next_[slot] = static_cast<std::int32_t>(terminal_.size());
+                    terminal_.push_back(none);
+                    next_.resize(next_.size() + alphabet_, none);
+                }
+                state = next_[slot];
+            }
+
+            std::int32_t& terminal{terminal_[static_cast<size_type>(state)]};
+            if (terminal == none) {
+                terminal = static_cast<std::int32_t>(index);
+            } else {
+                duplicate_[index] = duplicate_[static_cast<size_type>(terminal)];
+                duplicate_[static_cast<size_type>(terminal)] = static_cast<std::int32_t>(index);
+            }
+        }
+
+        std::vector<std::int32_t> fail(terminal_.size(), 0);
+        output_.assign(terminal_.size(), none);
+        std::deque<std::int32_t> queue;
+        for (size_type symbol{}; symbol < alphabet_; ++symbol) {
+            if (next_[symbol] == none) {
+                next_[symbol] = 0;
+            } else {
+                queue.push_back(next_[symbol]);
+            }
+        }
+
+        while (!queue.empty()) {
+            size_type state{static_cast<size_type>(queue.front())};
+            queue.pop_front();
+            size_type back{static_cast<size_type>(fail[state])};
+            for (size_type symbol{}; symbol < alphabet_; ++symbol) {
+                std::int32_t& target{next_[state * alphabet_ + symbol]};
+                if (target == none) {
+                    target = next_[back * alphabet_ + symbol];
+                    continue;
+                }
+
+                std::int32_t suffix{next_[back * alphabet_ + symbol]};
+                fail[static_cast<size_type>(target)] = suffix;
+                output_[static_cast<size_type>(target)] =
+                    terminal_[static_cast<size_type>(suffix)] != none ? suffix : output_[static_cast<size_type>(suffix)];
+                queue.push_back(target);
+            }
+        }
+    }
+
+    void scan(std::string_view text, std::vector<search_match>& out) const {
+        if (patterns_.size() == 1) {
+            find_single(text, out);
+            return;
+        }
+
+        std::int32_t state{};
+        const auto* data{reinterpret_cast<const unsigned char*>(text.data())};
+        for (size_type i{}; i < text.size(); ++i) {
+            state = next_[static_cast<size_type>(state) * alphabet_ + classes_[data[i]]];
+            std::int32_t hit{terminal_[static_cast<size_type>(state)] != none ? state : output_[static_cast<size_type>(state)]};
+            for (; hit != none; hit = output_[static_cast<size_type>(hit)]) {
+                for (std::int32_t index{terminal_[static_cast<size_type>(hit)]}; index != none;
+                     index = duplicate_[static_cast<size_type>(index)]) {
+                    size_type pattern{static_cast<size_type>(index)};
+                    out.push_back({ i + 1 - patterns_[pattern].size(), 0, pattern });
+                }
+            }
+        }
+        std::sort(out.begin(), out.end(), [](const search_match& lhs, const search_match& rhs) {
+            return lhs.offset != rhs.offset ? lhs.offset < rhs.offset : lhs.pattern < rhs.pattern;
+        });
+    }
+
+    void find_single(std::string_view text, std::vector<search_match>& out) const {
+        const std::string& pattern{patterns_.front()};
+        if (text.size() < pattern.size())
+            return;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+        if (simd::has_avx2()) {
+            find_single_avx2(text, pattern, out);
+            return;
+        }
+#endif
+
+        const char* data{text.data()};
+        size_type last{text.size() - pattern.size()};
+        for (size_type i{}; i <= last; ++i) {
+            const void* hit{std::memchr(data + i, pattern.front(), last - i + 1)};
+            if (!hit)
+                break;
+            i = static_cast<size_type>(static_cast<const char*>(hit) - data);
+            if (std::memcmp(data + i, pattern.data(), pattern.size()) == 0)
+                out.push_back({ i, 0, 0 });
+        }
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    __attribute__((target("avx2")))
+    static void find_single_avx2(std::string_view text, const std::string& pattern, std::vector<search_match>& out) {
+        const char* data{text.data()};
+        size_type length{pattern.size()};
+        size_type last{text.size() - length};
+        const __m256i first{_mm256_set1_epi8(pattern.front())};
+        const __m256i final{_mm256_set1_epi8(pattern.back())};
+
+        size_type i{};
+        for (; i + 32 <= last + 1; i += 32) {
+            __m256i head{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i))};
+            __m256i tail{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + length - 1))};
+            auto mask{static_cast<unsigned>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, final))))};
+            for (; mask; mask &= mask - 1) {
+                size_type position{i + static_cast<size_type>(__builtin_ctz(mask))};
+                if (length <= 2 || std::memcmp(data + position + 1, pattern.data() + 1, length - 2) == 0)
+                    out.push_back({ position, 0, 0 });
+            }
+        }
+        for (; i <= last; ++i) {
+            if (data[i] == pattern.front() && std::memcmp(data + i, pattern.data(), length) == 0)
+                out.push_back({ i, 0, 0 });
+        }
+    }
+#endif
+
+    static void number_lines(std::string_view text, std::vector<search_match>& matches, size_type line) noexcept {
+        size_type position{};
+        for (search_match& match : matches) {
+            line += simd::count_byte(text.data() + position, match.offset - position, '\n');
+            position = match.offset;
+            match.line = line;
+        }
+    }
+
+private:
+    std::vector<std::string> patterns_;
+    size_type max_length_{};
+    std::array<std::uint16_t, 256> classes_{};
+    size_type alphabet_{};
+    std::vector<std::int32_t> next_;
+    std::vector<std::int32_t> terminal_;
+    std::vector<std::int32_t> output_;
+    std::vector<std::int32_t> duplicate_;
+};
+
+inline std::vector<search_match> search(const file_t& file, const searcher& patterns) {
+    return patterns.find(file.view());
+}
+
+inline std::vector<search_match> search(const file_t& file, std::string_view pattern) {
+    return searcher(pattern).find(file.view());
+}
+
+inline std::vector<search_match> search(stream_t& stream, const searcher& patterns) {
+    return patterns.find(stream);
+}
+
+/*
+    Maps and searches the files on up to threads workers (0 for all cores).
+    Directories, FIFOs, sockets and devices are skipped with an error; they
+    are opened non-blocking so a FIFO without a writer cannot stall a worker.
+*/
+inline std::vector<file_matches> search(std::span<const fs::path> paths, const searcher& patterns, std::size_t threads = 0) {
+    std::vector<file_matches> results(paths.size());
+    if (paths.empty())
+        return results;
+
+    if (!threads)
+        threads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+
+    thread::pool workers(std::min(threads, paths.size()));
+    for (std::size_t i{}; i < paths.size(); ++i) {
+        workers.submit([&paths, &patterns, &results, i] {
+            file_matches& result{results[i]};
+            result.path = paths[i];
+
+            descriptor fd(::open(paths[i].c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOCTTY));
+            struct stat info{};
+            if (!fd || ::fstat(fd.get(), &info) == -1) {
+                result.error = std::error_code(errno, std::system_category());
+                return;
+            }
+            if (!S_ISREG(info.st_mode)) {
+                result.error = std::make_error_code(S_ISDIR(info.st_mode) ? std::errc::is_a_directory : std::errc::not_supported);
+                return;
+            }
+
+            try {
+                mapped_region region(fd.get(), static_cast<std::size_t>(info.st_size));
+                region.advise(mapped_region::advice::sequential);
+                result.matches = patterns.find(region.view());
+            } catch (const std::exception&) {
+                result.error = std::make_error_code(std::errc::io_error);
+            }
+        });
+    }
+    workers.wait();
+    return results;
+}
+
+struct csv_options {
+    char delimiter{','};
+    char quote{'"'};
+    std::size_t threads{1};
+};
+
+/*
+    CSV/TSV reader with a SIMD structural index in the style of simdcsv.
+    Every 64 bytes become bitmasks of quotes, delimiters and newlines; a
+    prefix xor of the quote mask marks the bytes inside quotes, and the
+    delimiters and newlines left over are recorded as uint32 offsets.
+    Large texts are indexed in parallel chunks: a first pass counts quotes
+    per chunk, so each chunk knows whether it starts inside a quoted field.
+    Fields are views with the outer quotes removed; doubled quotes stay as
+    they are until unescape(). Over a stream_t the views last until the
+    next call, over a text or file_t as long as the reader.
+*/
+class csv {
+private:
+    using size_type = std::size_t;
+
+    struct chunk_index {
+        size_type base{};
+        std::vector<std::uint32_t> positions;
+    };
+
+    static constexpr size_type parallel_threshold{4 * 1024 * 1024};
+    static constexpr size_type max_chunk{1024 * 1024 * 1024};
+
+public:
+    explicit csv(std::string_view text, csv_options options = {}) :
+        options_(options),
+        text_(text)
+    {
+        index_all(options_.threads);
+    }
+
+    explicit csv(const file_t& file, csv_options options = {}) :
+        options_(options),
+        owner_(file.get_buffer()),
+        text_(owner_.view())
+    {
+        index_all(options_.threads);
+    }
+
+    explicit csv(stream_t& stream, csv_options options = {}) :
+        options_(options),
+        stream_(&stream)
+    {}
+
+    csv(const csv&) = delete;
+
+public:
+    csv& operator=(const csv&) = delete;
+
+public:
+    /*
+        Fills fields with the next record; false once the input is done
+    */
+    bool next(std::vector<std::string_view>& fields) {
+        fields.clear();
+        while (true) {
+            if (chunk_ < chunks_.size() && position_ == chunks_[chunk_].positions.size()) {
+                ++chunk_;
+                position_ = 0;
+                continue;
+            }
+
+            if (chunk_ == chunks_.size()) {
+                if (stream_ && refill(fields))
+                    continue;
+                if (start_ >= text_.size() && fields.empty())
+                    return false;
+
+                push_field(fields, text_.size());
+                start_ = text_.size();
+                return true;
+            }
+
+            const chunk_index& chunk{chunks_[chunk_]};
+            size_type offset{chunk.base + chunk.positions[position_++]};
+            push_field(fields, offset);
+            start_ = offset + 1;
+            if (text_[offset] == '\n') {
+                record_ = start_;
+                return true;
+            }
+        }
+    }
+
+    static std::string unescape(std::string_view field, char quote = '"') {
+        std::string result;
+        result.reserve(field.size());
+        for (size_type i{}; i < field.size(); ++i) {
+            result.push_back(field[i]);
+            if (field[i] == quote && i + 1 < field.size() && field[i + 1] == quote)
+                ++i;
+        }
+        return result;
+    }
+
+private:
+    void push_field(std::vector<std::string_view>& fields, size_type end) const {
+        std::string_view field{text_.substr(start_, end - start_)};
+        if (end < text_.size() && text_[end] == '\n' && !field.empty() && field.back() == '\r')
+            field.remove_suffix(1);
+        if (end == text_.size() && !field.empty() && field.back() == '\r')
+            field.remove_suffix(1);
+        if (field.size() >= 2 && field.front() == options_.quote && field.back() == options_.quote)
+            field = field.substr(1, field.size() - 2);
+        fields.push_back(field);
+    }
+
+    /*
+        Stream mode: keeps the unfinished record, appends the next chunk
+        and indexes only the new bytes, starting from the quote state the
+        previous scan ended in. Fields collected so far are moved along
+        when the window shifts or grows.
+    */
+    bool refill(std::vector<std::string_view>& fields) {
+        std::string_view chunk;
+        if (!stream_->next(chunk))
+            return false;
+
+        std::vector<size_type> offsets;
+        bool moves{record_ || window_.size() + chunk.size() > window_.capacity()};
+        if (moves) {
+            for (std::string_view field : fields)
+                offsets.push_back(static_cast<size_type>(field.data() - window_.data()) - record_);
+        }
+
+        window_.erase(0, record_);
+        window_.append(chunk);
+        if (window_.size() > std::numeric_limits<std::uint32_t>::max())
+            throw std::out_of_range("Error: Record is too large");
+
+        text_ = window_;
+        start_ -= record_;
+        scanned_ -= record_;
+        record_ = 0;
+        if (moves) {
+            for (size_type i{}; i < fields.size(); ++i)
+                fields[i] = text_.substr(offsets[i], fields[i].size());
+        }
+
+        chunks_.resize(1);
+        chunks_[0].base = 0;
+        chunks_[0].positions.clear();
+        chunk_ = position_ = 0;
+        inside_ = index(text_, inside_, chunks_[0].positions, scanned_);
+        scanned_ = text_.size();
+        return true;
+    }
+
+    void index_all(size_type threads) {
+        chunks_.clear();
+        chunk_ = position_ = 0;
+        if (text_.empty())
+            return;
+
+        if (!threads)
+            threads = std::max<size_type>(1, std::thread::hardware_concurrency());
+        if (text_.size() < parallel_threshold)
+            threads = 1;
+
+        size_type count{std::max(threads, (text_.size() + max_chunk - 1) / max_chunk)};
+        size_type size{(text_.size() + count - 1) / count};
+        chunks_.resize(count);
+        std::vector<char> inside(count);
+
+        auto part{[this, size](size_type i) {
+            size_type base{std::min(text_.size(), i * size)};
+            return text_.substr(base, std::min(size, text_.size() - base));
+        }};
+
+        if (threads < 2) {
+            bool state{};
+            for (size_type i{}; i < count; ++i) {
+                chunks_[i].base = i * size;
+                state = index(part(i), state, chunks_[i].positions);
+            }
+            return;
+        }
+
+        thread::pool workers(std::min(threads, count));
+        std::vector<size_type> quotes(count);
+        for (size_type i{}; i < count; ++i) {
+            workers.submit([this, &quotes, &part, i] {
+                std::string_view text{part(i)};
+                quotes[i] = simd::count_byte(text.data(), text.size(), options_.quote);
+            });
+        }
+        workers.wait();
+
+        for (size_type i{1}; i < count; ++i)
+            inside[i] = static_cast<char>(inside[i - 1] ^ (quotes[i - 1] & 1));
+
+        for (size_type i{}; i < count; ++i) {
+            workers.submit([this, &inside, &part, size, i] {
+                chunks_[i].base = i * size;
+                index(part(i), inside[i], chunks_[i].positions);
+            });
+        }
+        workers.wait();
+    }
+
+    /*
+        Appends the offsets of structural characters and returns whether
+        the text ends inside quotes
+    */
+    bool index(std::string_view text, bool inside, std::vector<std::uint32_t>& out, size_type from = 0) const {
+        size_type i{from};
+#if defined(__x86_64__) && defined(__GNUC__)
+        if (simd::has_avx2())
+            inside = index_avx2(text, inside, out, i);
+#endif
+        for (; i < text.size(); ++i) {
+            char byte{text[i]};
+            if (byte == options_.quote) {
+                inside = !inside;
+            } else if (!inside && (byte == options_.delimiter || byte == '\n')) {
+                out.push_back(static_cast<std::uint32_t>(i));
+            }
+        }
+        return inside;
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    __attribute__((target("avx2")))
+    static std::uint64_t mask(__m256i low, __m256i high, __m256i needle) noexcept {
+        auto first{static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, needle)))};
+        auto second{static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, needle)))};
+        return first | (static_cast<std::uint64_t>(second) << 32);
+    }
+
+    __attribute__((target("avx2")))
+    bool index_avx2(std::string_view text, bool inside, std::vector<std::uint32_t>& out, size_type& i) const {
+        const __m256i quote{_mm256_set1_epi8(options_.quote)};
+        const __m256i delimiter{_mm256_set1_epi8(options_.delimiter)};
+        const __m256i newline{_mm256_set1_epi8('\n')};
+        std::uint64_t carry{inside ? ~std::uint64_t{} : 0};
+
+        for (; i + 64 <= text.size(); i += 64) {
+            __m256i low{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + i))};
+            __m256i high{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + i + 32))};
+
+            std::uint64_t quoted{mask(low, high, quote)};
+            for (unsigned shift{1}; shift < 64; shift <<= 1)
+                quoted ^= quoted << shift;
+            quoted ^= carry;
+            carry = static_cast<std::uint64_t>(static_cast<std::int64_t>(quoted) >> 63);
+
+            std::uint64_t structural{(mask(low, high, delimiter) | mask(low, high, newline)) & ~quoted};
+            for (; structural; structural &= structural - 1)
+                out.push_back(static_cast<std::uint32_t>(i + static_cast<size_type>(__builtin_ctzll(structural))));
+        }
+        return carry != 0;
+    }
+#endif
+
+private:
+    csv_options options_;
+    shared_buffer owner_;
+    std::string_view text_;
+    stream_t* stream_{};
+    std::string window_;
+    std::vector<chunk_index> chunks_;
+    size_type chunk_{};
+    size_type position_{};
+    size_type start_{};
+    size_type record_{};
+    size_type scanned_{};
+    bool inside_{};
+};
+
+enum class copy_method { clone, copy_range, sendfile, buffered };
+
+struct copy_options {
+    bool overwrite{true};
+    bool sparse{true};
+    std::size_t threads{};
+    walk_options walk;
+};
+
+/*
+    Copies one open file into another, trying a reflink (FICLONE) first and
+    then copy_file_range, sendfile and a pread/pwrite loop, each falling
+    back to the next when the file systems involved do not support it.
+    With sparse only the data segments found with SEEK_DATA/SEEK_HOLE are
+    copied and the target is extended over the holes.
+*/
+class file_copier {
+private:
+    using size_type = std::size_t;
+
+    static constexpr size_type buffer_size{1024 * 1024};
+    static constexpr size_type max_request{1024 * 1024 * 1024};
+
+public:
+    file_copier(int in, int out) noexcept :
+        in_(in),
+        out_(out)
+    {}
+
+public:
+    /*
+        Returns the last method used; a source that shrinks while being
+        copied ends the copy at its new size
+    */
+    copy_method run(std::uint64_t size, bool sparse, std::error_code& error) {
+#if defined(__linux__) && defined(FICLONE)
+        if (::ioctl(out_, FICLONE, in_) == 0)
+            return copy_method::clone;
+#endif
+
+        for (std::uint64_t position{}; position < size;) {
+            std::uint64_t begin{position};
+            std::uint64_t end{size};
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+            if (sparse) {
+                off_t data{::lseek(in_, static_cast<off_t>(position), SEEK_DATA)};
+                if (data == -1 && errno == ENXIO)
+                    break;
+                if (data == -1) {
+                    sparse = false;
+                } else {
+                    off_t hole{::lseek(in_, data, SEEK_HOLE)};
+                    begin = static_cast<std::uint64_t>(data);
+                    end = hole == -1 ? size : std::min(size, static_cast<std::uint64_t>(hole));
+                }
+            }
+#endif
+            if (begin >= end)
+                break;
+
+            std::uint64_t done{copy(begin, end - begin, error)};
+            if (error)
+                return method_;
+            if (done < end - begin) {
+                size = begin + done;
+                break;
+            }
+            position = end;
+        }
+
+        if (sparse && ::ftruncate(out_, static_cast<off_t>(size)) == -1)
+            error = std::error_code(errno, std::system_category());
+        return method_;
+    }
+
+private:
+    std::uint64_t copy(std::uint64_t offset, std::uint64_t size, std::error_code& error) {
+        std::uint64_t done{};
+        while (done < size) {
+            size_type count{static_cast<size_type>(std::min<std::uint64_t>(size - done, max_request))};
+            off_t position{static_cast<off_t>(offset + done)};
+            ssize_t moved{transfer(position, count)};
+            if (moved == -1) {
+                if (errno == EINTR)
+                    continue;
+                if (fall_back())
+                    continue;
+                error = std::error_code(errno, std::system_category());
+                break;
+            }
+            if (moved == 0) {
+                // Some file systems end copy_file_range and sendfile early;
+                // only a plain read reporting EOF means the source shrank
+                if (next_method())
+                    continue;
+                break;
+            }
+            done += static_cast<std::uint64_t>(moved);
+        }
+        return done;
+    }
+
+    ssize_t transfer(off_t position, size_type count) {
+        switch (method_) {
+#if defined(__linux__)
+            case copy_method::copy_range: {
+                loff_t in_offset{position};
+                loff_t out_offset{position};
+                return ::copy_file_range(in_, &in_offset, out_, &out_offset, count, 0);
+            }
+            case copy_method::sendfile: {
+                if (::lseek(out_, position, SEEK_SET) == -1)
+                    return -1;
+                off_t in_offset{position};
+                return ::sendfile(out_, in_, &in_offset, count);
+            }
+#endif
+            default:
+                break;
+        }
+
+        if (!buffer_)
+            buffer_ = std::make_unique_for_overwrite<char[]>(buffer_size);
+        ssize_t count_read{::pread(in_, buffer_.get(), std::min(count, buffer_size), position)};
+        for (ssize_t written{}; written < count_read;) {
+            ssize_t count_written{::pwrite(out_, buffer_.get() + written, static_cast<size_type>(count_read - written),
+                                           position + written)};
+            if (count_written == -1) {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            written += count_written;
+        }
+        return count_read;
+    }
+
+    /*
+        Moves to the next method when errno says the current one is not
+        supported for this pair of files
+    */
+    bool fall_back() noexcept {
+        bool unsupported{errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+                         errno == EOPNOTSUPP || errno == ENOTSUP || errno == EBADF};
+        return unsupported && next_method();
+    }
+
+    bool next_method() noexcept {
+        if (method_ == copy_method::buffered)
+            return false;
+
+        method_ = method_ == copy_method::copy_range ? copy_method::sendfile : copy_method::buffered;
+        return true;
+    }
+
+private:
+    int in_;
+    int out_;
+#if defined(__linux__)
+    copy_method method_{copy_method::copy_range};
+#else
+    copy_method method_{copy_method::buffered};
+#endif
+    std::unique_ptr<char[]> buffer_;
+};
+
+struct read_result {
+    file_t file;
+    std::error_code error;
+};
+
+class monitoring {
+private:
+    using size_type = std::size_t;
+    using mod       = console::ansi::mods;
+    using color     = console::ansi::colors;
+    using path_reference   = const fs::path&;
+    using string_reference = const std::string&;
+
+public:
+    enum class read_mode { automatic, read, map };
+
+public:
+    monitoring() = default;
+    ~monitoring() = default;
+
+public:
+    void set_mmap_threshold(size_type size) noexcept { mmap_threshold_ = size; }
+
+    size_type get_mmap_threshold() const noexcept { return mmap_threshold_; }
+
+    void set_read_budget(size_type bytes) noexcept { read_budget_ = std::max<size_type>(1, bytes); }
+
+    size_type get_read_budget() const noexcept { return read_budget_; }
+
+    void set_stat_cache(std::shared_ptr<stat_cache> cache) noexcept { stat_cache_ = std::move(cache); }
+
+    std::shared_ptr<stat_cache> get_stat_cache() const noexcept { return stat_cache_; }
+
+#if defined(__linux__)
+    void set_descriptor_cache(std::shared_ptr<descriptor_cache> cache) noexcept { descriptor_cache_ = std::move(cache); }
+
+    std::shared_ptr<descriptor_cache> get_descriptor_cache() const noexcept { return descriptor_cache_; }
+#endif
+
+    void set_content_cache(std::shared_ptr<content_cache> cache) noexcept { content_cache_ = std::move(cache); }
+
+    std::shared_ptr<content_cache> get_content_cache() const noexcept { return content_cache_; }
+
+    metadata get_metadata(path_reference path, unsigned mask = stat_mask::all) const {
+        return stat_cache_ ? stat_cache_->get(path, mask) : filesystem::get_metadata(path, mask);
+    }
+
+public:
+    file_t read_file(path_reference path, read_mode mode = read_mode::automatic) const {
+        if (content_cache_ && mode != read_mode::map)
+            return read_cached(path, mode);
+        return load_file(path, mode);
+    }
+
+    file_t read_file(string_reference path, read_mode mode = read_mode::automatic) const {
+        return read_file(fs::path(path), mode);
+    }
+
+    void read_file(file_t& file, read_mode mode = read_mode::automatic) const {
+        file = read_file(file.get_path_fs(), mode);
+    }
+
+    /*
+        Loads files concurrently. Results keep the order of paths and carry
+        an error_code instead of throwing. Small files are packed into shared
+        arena blocks; at most read_budget bytes are being read at any time.
+    */
+    std::vector<read_result> read_files(std::span<const fs::path> paths, size_type threads = 0) const {
+        std::vector<read_result> results(paths.size());
+        if (paths.empty())
+            return results;
+
+        if (!threads)
+            threads = std::max<size_type>(1, std::thread::hardware_concurrency());
+        threads = std::min(threads, paths.size());
+
+        batch_state state(read_budget_);
+        {
+            thread::pool workers(threads);
+            for (size_type i{}; i < paths.size(); ++i) {
+                workers.submit([&state, &paths, &results, i] {
+                    load_into(state, paths[i], results[i]);
+                });
+            }
+            workers.wait();
+        }
+
+        return results;
+    }
+
+    stream_t stream(path_reference path, size_type chunk_size = 1024 * 1024, size_type depth = 1) const {
+        return stream_t(path, chunk_size, depth);
+    }
+
+    stream_t stream(string_reference path, size_type chunk_size = 1024 * 1024, size_type depth = 1) const {
+        return stream(fs::path(path), chunk_size, depth);
+    }
+
+#if defined(__linux__)
+    /*
+        Reads only what gets appended from now on (or from the start),
+        surviving truncation and log rotation.
+    */
+    follower follow(path_reference path, bool from_start = false) const {
+        return follower(path, from_start);
+    }
+#endif
+
+    void write_file(path_reference path, std::string_view text) const {
+        std::shared_ptr<const descriptor> fd{open_descriptor(path, O_WRONLY | O_APPEND | O_NONBLOCK)};
+        if (!fd) {
+            if (errno == ENOENT || errno == ENOTDIR || errno == EISDIR)
+                return;
+            std::string error_text{"Error: Cannot open file: "};
+            std::string filename{path.filename().generic_string()};
+            throw std::ios_base::failure(error_text + filename);
+        }
+
+        write_full(fd->get(), text);
+        invalidate_caches(path);
+    }
+
+    void create_file(const file_t& file) const {
+        fs::path path(file.get_path_fs());
+        std::ofstream file_stream(path, std::ios::out);
+
+        if (file_stream.is_open()) {
+            std::string_view text{file.view()};
+            file_stream.write(text.data(), static_cast<std::streamsize>(text.size()));
+            file_stream.close();
+            invalidate_caches(path);
+        } else {
+            std::string error_text{"Error: Cannot create file: "};
+            std::string filename{path.filename().generic_string()};
+            throw std::ios_base::failure(error_text + filename);
+        }
+    }
+
+    void create_file(const file_t& file, durability level) const {
+        atomic_file target(file.get_path_fs());
+        target.write(file.view());
+        target.commit(level);
+        invalidate_descriptor(file.get_path_fs());
+        invalidate_caches(file.get_path_fs());
+    }
+
+    void create_file(path_reference path) const {
+        create_file(file_t(path));
+    }
+
+    void create_file(string_reference path) const {
+        create_file(fs::path(path));
+    }
+
+    /*
+        Copies source to target without passing the data through user space
+        where the kernel allows it (see file_copier); a new target gets the
+        mode of source.
+    */
+    copy_method copy_file(path_reference source, path_reference target, const copy_options& options = {}) const {
+        std::error_code error;
+        copy_method method{copy_one(source, target, options, error)};
+        invalidate_descriptor(target);
+        invalidate_caches(target);
+        if (error) {
+            std::string error_text{"Error: Cannot copy file: "};
+            std::string filename{source.filename().generic_string()};
+            throw std::ios_base::failure(error_text + filename);
+        }
+        return method;
+    }
+
+    copy_method copy_file(string_reference source, string_reference target, const copy_options& options = {}) const {
+        return copy_file(fs::path(source), fs::path(target), options);
+    }
+
+    /*
+        Recreates the tree under source at target: directories and symlinks
+        first, then the regular files on options.threads workers. Failures
+        go to options.walk.on_error and do not stop the copy. Returns the
+        number of files copied.
+    */
+    size_type copy_tree(path_reference source, path_reference target, const copy_options& options = {}) const {
+        std::vector<walk_entry> entries{walk(source, options.walk)};
+        std::sort(entries.begin(), entries.end(), [](const walk_entry& lhs, const walk_entry& rhs) {
+            return lhs.depth < rhs.depth;
+        });
+
+        std::error_code error;
+        fs::create_directories(target, error);
+        if (error) {
+            std::string error_text{"Error: Cannot create directory: "};
+            std::string filename{target.filename().generic_string()};
+            throw std::ios_base::failure(error_text + filename);
+        }
+
+        auto report{[&options](path_reference path, std::error_code code) {
+            if (options.walk.on_error)
+                options.walk.on_error(path, code);
+        }};
+
+        std::vector<std::pair<const fs::path*, fs::path>> files;
+        for (const walk_entry& entry : entries) {
+            fs::path destination{target / entry.path.lexically_relative(source)};
+            error.clear();
+            if (entry.type == fs::file_type::directory)
+                fs::create_directory(destination, entry.path, error);
+            else if (entry.type == fs::file_type::symlink)
+                fs::copy_symlink(entry.path, destination, error);
+            else if (entry.type == fs::file_type::regular)
+                files.emplace_back(&entry.path, std::move(destination));
+
+            if (error)
+                report(entry.path, error);
+        }
+        if (files.empty())
+            return 0;
+
+        std::atomic<size_type> copied{};
+        {
+            size_type threads{options.threads ? options.threads :
+                              std::max<size_type>(1, std::thread::hardware_concurrency())};
+            thread::pool workers(std::min(threads, files.size()));
+            for (const auto& [path, destination] : files) {
+                workers.submit([&options, &report, &copied, path, &destination] {
+                    std::error_code code;
+                    copy_one(*path, destination, options, code);
+                    if (code)
+                        report(*path, code);
+                    else
+                        copied.fetch_add(1, std::memory_order_relaxed);
+                });
+            }
+            workers.wait();
+        }
+        for (const auto& item : files) {
+            invalidate_descriptor(item.second);
+            invalidate_caches(item.second);
+        }
+        return copied.load();
+    }
+
+    size_type copy_tree(string_reference source, string_reference target, const copy_options& options = {}) const {
+        return copy_tree(fs::path(source), fs::path(target), options);
+    }
+
+public:
+    std::string get_file_path() const {
+        fs::path path(fs::current_path());
+        while (true) {
+            std::string path_str{path.generic_string()};
+
+            print_filesystem(path_str);
+            print_menu(path_str);
+
+            std::string opt;
+            std::cin >> opt;
+            if (opt == "0") {
+                break;
+            } else if (opt == "d") {
+                return path_str;
+            } else if (opt == "b") {
+                path = path.parent_path();
+            } else if (opt == "c") {
+                console::print_text("\nEnter filename: ", color::blue, "", " ");
+                std::string filename;
+                std::cin >> filename;
+                create_file(path / filename);
+                continue;
+            } else if (dirs_.find(opt) != dirs_.end()) {
+                auto [is_dir, name]{dirs_[opt]};
+                path /= name;
+
+                if (!is_dir) {
+                    path_str = path.generic_string();
+                    if (!get_metadata(path, stat_mask::type).exists()) {
+                        console::print_text("The file does not exist", color::red, "", " ");
+                        continue;
+                    }
+                    return path_str;
+                }
+            }
+        }
+        
+        return "";
+    }
+
+private:
+    static constexpr size_type arena_block_size{1024 * 1024};
+    static constexpr size_type arena_max_file{64 * 1024};
+
+    struct batch_state {
+        explicit batch_state(size_type budget) : budget(budget), available(budget) {}
+
+        size_type acquire(size_type bytes) {
+            bytes = std::min(bytes, budget);
+            std::unique_lock<std::mutex> lock(mutex);
+            budget_cv.wait(lock, [this, bytes] { return available >= bytes; });
+            available -= bytes;
+            return bytes;
+        }
+
+        void release(size_type bytes) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                available += bytes;
+            }
+            budget_cv.notify_all();
+        }
+
+        std::pair<std::shared_ptr<char[]>, char*> allocate(size_type size) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!block || block_used + size > arena_block_size) {
+                block = std::make_shared_for_overwrite<char[]>(arena_block_size);
+                block_used = 0;
+            }
+            char* data{block.get() + block_used};
+            block_used += size;
+            return { block, data };
+        }
+
+        size_type budget;
+        size_type available;
+        std::shared_ptr<char[]> block;
+        size_type block_used{};
+        std::mutex mutex;
+        std::condition_variable budget_cv;
+    };
+
+    static void load_into(batch_state& state, path_reference path, read_result& result) noexcept {
+        try {
+            descriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+            if (!fd) {
+                result.error = std::error_code(errno, std::system_category());
+                return;
+            }
+
+            struct stat info{};
+            if (::fstat(fd.get(), &info) == -1) {
+                result.error = std::error_code(errno, std::system_category());
+                return;
+            }
+            if (S_ISDIR(info.st_mode)) {
+                result.error = std::make_error_code(std::errc::is_a_directory);
+                return;
+            }
+
+            size_type size{static_cast<size_type>(info.st_size)};
+            size_type reserved{state.acquire(size)};
+            try {
+                if (size <= arena_max_file) {
+                    auto [block, data]{state.allocate(size)};
+                    size_type done{read_full(fd.get(), data, size, result.error)};
+                    result.file = file_t(file_t::verified_path(), path, shared_buffer(std::move(block), data, done));
+                } else {
+                    std::string text{read_descriptor(fd.get(), size, result.error)};
+                    result.file = file_t(file_t::verified_path(), path, shared_buffer(std::move(text)));
+                }
+            } catch (...) {
+                state.release(reserved);
+                throw;
+            }
+            state.release(reserved);
+        } catch (const std::bad_alloc&) {
+            result.error = std::make_error_code(std::errc::not_enough_memory);
+        } catch (const fs::filesystem_error& error) {
+            result.error = error.code();
+        } catch (const std::exception&) {
+            result.error = std::make_error_code(std::errc::file_too_large);
+        }
+    }
+
+    static copy_method copy_one(path_reference source, path_reference target, const copy_options& options,
+                                std::error_code& error) noexcept {
+        try {
+            descriptor in(::open(source.c_str(), O_RDONLY | O_CLOEXEC));
+            struct stat info{};
+            if (!in || ::fstat(in.get(), &info) == -1) {
+                error = std::error_code(errno, std::system_category());
+                return copy_method::buffered;
+            }
+            if (S_ISDIR(info.st_mode)) {
+                error = std::make_error_code(std::errc::is_a_directory);
+                return copy_method::buffered;
+            }
+
+            struct stat existing{};
+            if (::stat(target.c_str(), &existing) == 0 && existing.st_dev == info.st_dev && existing.st_ino == info.st_ino) {
+                error = std::make_error_code(std::errc::file_exists);
+                return copy_method::buffered;
+            }
+
+            int flags{O_WRONLY | O_CREAT | O_CLOEXEC | (options.overwrite ? O_TRUNC : O_EXCL)};
+            descriptor out(::open(target.c_str(), flags, info.st_mode & 07777));
+            if (!out) {
+                error = std::error_code(errno, std::system_category());
+                return copy_method::buffered;
+            }
+
+            auto size{static_cast<std::uint64_t>(info.st_size)};
+            bool sparse{options.sparse && static_cast<std::uint64_t>(info.st_blocks) * 512 < size};
+            return file_copier(in.get(), out.get()).run(size, sparse, error);
+        } catch (const std::bad_alloc&) {
+            error = std::make_error_code(std::errc::not_enough_memory);
+            return copy_method::buffered;
+        }
+    }
+
+    file_t load_file(path_reference path, read_mode mode) const {
+        std::shared_ptr<const descriptor> fd{open_descriptor(path, O_RDONLY)};
+        if (!fd) {
+            if (errno == ENOENT || errno == ENOTDIR)
+                return file_t();
+            std::string error_text{"Error: Cannot open file: "};
+            std::string filename{path.filename().generic_string()};
+            throw std::ios_base::failure(error_text + filename);
+        }
+
+        struct stat info{};
+        if (::fstat(fd->get(), &info) == -1)
+            throw std::ios_base::failure("Error: Cannot stat file");
+
+        if (S_ISDIR(info.st_mode))
+            return file_t();
+
+        size_type size{static_cast<size_type>(info.st_size)};
+        bool use_map{mode == read_mode::map ||
+                     (mode == read_mode::automatic && size && size >= mmap_threshold_)};
+
+        if (use_map && S_ISREG(info.st_mode))
+            return file_t(file_t::verified_path(), path, shared_buffer(mapped_region(fd->get(), size)));
+
+        return file_t(file_t::verified_path(), path, shared_buffer(read_descriptor(fd->get(), size)));
+    }
+
+    /*
+        Returns nullptr with errno set on failure
+    */
+    std::shared_ptr<const descriptor> open_descriptor(path_reference path, int flags) const {
+#if defined(__linux__)
+        if (descriptor_cache_)
+            return descriptor_cache_->open(path, flags);
+#endif
+        descriptor fd(::open(path.c_str(), flags | O_CLOEXEC));
+        if (!fd)
+            return nullptr;
+        return std::make_shared<const descriptor>(std::move(fd));
+    }
+
+    /*
+        Called after the paths that put a new inode or new contents behind
+        a name; plain appends keep their cached descriptor
+    */
+    void invalidate_descriptor([[maybe_unused]] path_reference path) const {
+#if defined(__linux__)
+        if (descriptor_cache_)
+            descriptor_cache_->invalidate(path);
+#endif
+    }
+
+    /*
+        Called after every write this object makes, so its own caches never
+        serve what it has just replaced. The parent listing is dropped here
+        too rather than left to the watcher thread, which may run later.
+    */
+    void invalidate_caches(path_reference path) const {
+        if (stat_cache_)
+            stat_cache_->invalidate(path);
+        if (content_cache_)
+            content_cache_->invalidate(path);
+#if defined(__linux__)
+        if (listing_cache_)
+            listing_cache_->invalidate(path.parent_path());
+#endif
+    }
+
+    /*
+        Only plain reads are cached: files that automatic mode would map,
+        or that could never fit the cache budget, go to load_file as is.
+        Entries are checked against a fresh stat, never the stat cache.
+    */
+    file_t read_cached(path_reference path, read_mode mode) const {
+        metadata info{filesystem::get_metadata(path)};
+        bool mapped{mode == read_mode::automatic && info.size && info.size >= mmap_threshold_};
+        if (!info.is_regular() || mapped || info.size > content_cache_->budget())
+            return load_file(path, mode);
+
+        shared_buffer buffer;
+        if (content_cache_->lookup(path, info, buffer))
+            return file_t(file_t::verified_path(), path, std::move(buffer));
+
+        file_t file{load_file(path, read_mode::read)};
+        content_cache_->insert(path, info, file.get_buffer());
+        return file;
+    }
+
+    /*
+        Reads the whole descriptor straight into the returned string:
+        no zero-fill where resize_and_overwrite is available, no extra copies.
+        pread leaves the offset of shared cached descriptors alone.
+    */
+    static std::string read_descriptor(int fd, size_type size) {
+        std::error_code error;
+        std::string text{read_descriptor(fd, size, error)};
+        if (error)
+            throw std::ios_base::failure("Error: Cannot read file");
+        return text;
+    }
+
+    static std::string read_descriptor(int fd, size_type size, std::error_code& error) {
+        std::string text;
+        auto fill{[fd, &error](char* data, size_type size) noexcept {
+            return pread_full(fd, data, size, 0, error);
+        }};
+
+#if defined(__cpp_lib_string_resize_and_overwrite)
+        text.resize_and_overwrite(size, fill);
+#else
+        text.resize(size);
+        text.resize(fill(text.data(), size));
+#endif
+        return text;
+    }
+
+    void print_filesystem(std::string_view path) const {
+        console::console_clear();
+        console::print_text("DIRS / FILES:\n", color::blue, mod::bold);
+        int num{1};
+        dirs_.clear();
+        auto listing{get_listing(fs::path(path))};
+        for (const auto& entry : *listing) {
+            if (entry.is_dir) {
+                console::print_text(std::to_string(num) + ".", color::red, "", " ");
+                console::print_text("(Dir)", color::blue, mod::bold, "\t");
+                dirs_[std::to_string(num)] = { true, entry.name };
+            } else {
+                console::print_text(std::to_string(num) + ".", color::red, "", " ");
+                console::print_text("(File)", color::green, mod::bold, "\t");
+                dirs_[std::to_string(num)] = { false, entry.name };
+            }
+            console::print_text(entry.name);
+            num++;
+        }
+    }
+
+    std::shared_ptr<const listing_t> get_listing(path_reference path) const {
+#if defined(__linux__)
+        if (!listing_cache_)
+            listing_cache_ = std::make_shared<directory_cache>();
+        return listing_cache_->list(path);
+#else
+        return std::make_shared<const listing_t>(list_directory(path));
+#endif
     }
 
     void print_menu(std::string_view path) const noexcept {
@@ -454,7 +7274,17 @@ private:
     }
 
 private:
+    size_type mmap_threshold_{4 * 1024 * 1024};
+    size_type read_budget_{256 * 1024 * 1024};
+    std::shared_ptr<stat_cache> stat_cache_;
+    std::shared_ptr<content_cache> content_cache_;
+#if defined(__linux__)
+    std::shared_ptr<descriptor_cache> descriptor_cache_;
+#endif
     mutable std::map<std::string, std::pair<bool, std::string>> dirs_;
+#if defined(__linux__)
+    mutable std::shared_ptr<directory_cache> listing_cache_;
+#endif
 };
 } // namespace filesystem
 } // namespace console_tools
@@ -0,0 +1,225 @@
+/*
+    Known-answer checks for the hashes and UTF-8, run against the SIMD
+    paths and, when built with TOOLS_NO_SIMD, against the portable ones:
+
+        g++ -std=c++20 -O2 tests/known_answers.cpp -o known_answers && ./known_answers
+        g++ -std=c++20 -O2 -DTOOLS_NO_SIMD tests/known_answers.cpp -o known_answers && ./known_answers
+
+    Both builds must pass; the fast_hash digests below were produced by
+    the portable path, so a passing SIMD build matches it bit for bit.
+    UTF-8 validation is also compared with a byte-at-a-time reference.
+*/
+
+#include "../src/tools.hpp"
+
+#include <cstdio>
+
+namespace {
+int failures{};
+
+void check(bool condition, const char* what) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+std::string pattern(std::size_t size) {
+    std::string data(size, '\0');
+    for (std::size_t i{}; i < size; ++i)
+        data[i] = static_cast<char>((i * 31 + 7) ^ (i >> 8));
+    return data;
+}
+
+std::uint32_t crc32c_bitwise(const std::string& data) {
+    std::uint32_t crc{0xFFFFFFFFU};
+    for (unsigned char byte : data) {
+        crc ^= byte;
+        for (int bit{}; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0x82F63B78U & (0U - (crc & 1U)));
+    }
+    return ~crc;
+}
+
+// Well-formed sequences as in table 3-7 of the Unicode standard
+bool utf8_reference(const std::string& text) {
+    const auto* data{reinterpret_cast<const unsigned char*>(text.data())};
+    for (std::size_t i{}, size{text.size()}; i < size;) {
+        unsigned char lead{data[i]};
+        std::size_t length{lead < 0x80 ? 1U : lead >= 0xC2 && lead <= 0xDF ? 2U : lead >= 0xE0 && lead <= 0xEF ? 3U
+                           : lead >= 0xF0 && lead <= 0xF4 ? 4U : 0U};
+        if (!length || i + length > size)
+            return false;
+
+        unsigned char low{0x80};
+        unsigned char high{0xBF};
+        if (lead == 0xE0) low = 0xA0;
+        if (lead == 0xED) high = 0x9F;
+        if (lead == 0xF0) low = 0x90;
+        if (lead == 0xF4) high = 0x8F;
+        for (std::size_t k{1}; k < length; ++k) {
+            unsigned char byte{data[i + k]};
+            if (byte < (k == 1 ? low : 0x80) || byte > (k == 1 ? high : 0xBF))
+                return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+void hash_answers() {
+    using namespace tools::hash;
+
+    check(xxh64::compute("") == 0xEF46DB3751D8E999ULL, "xxh64 of \"\"");
+    check(xxh64::compute("a") == 0xD24EC4F1A98C6E5BULL, "xxh64 of \"a\"");
+    check(xxh64::compute("abc") == 0x44BC2CF5AD770999ULL, "xxh64 of \"abc\"");
+    check(xxh64::compute("Nobody inspects the spammish repetition") == 0xFBCEA83C8A378BF1ULL,
+          "xxh64 of a 39-byte text");
+
+    // RFC 3720, appendix B.4
+    std::string zeros(32, '\0');
+    std::string ones(32, '\xFF');
+    std::string up(32, '\0');
+    std::string down(32, '\0');
+    for (std::size_t i{}; i < 32; ++i) {
+        up[i] = static_cast<char>(i);
+        down[i] = static_cast<char>(31 - i);
+    }
+    check(crc32c::compute("123456789") == 0xE3069283U, "crc32c of \"123456789\"");
+    check(crc32c::compute(zeros) == 0x8A9136AAU, "crc32c of 32 zero bytes");
+    check(crc32c::compute(ones) == 0x62A8AB43U, "crc32c of 32 0xFF bytes");
+    check(crc32c::compute(up) == 0x46DD794EU, "crc32c of 0..31");
+    check(crc32c::compute(down) == 0x113FDB5CU, "crc32c of 31..0");
+
+    std::string data{pattern(1 << 20)};
+    bool bitwise{true};
+    for (std::size_t size : {0, 1, 7, 8, 9, 63, 4095, 4096, 4097, 3 * 4096 + 5, 100000}) {
+        bitwise = bitwise && crc32c::compute(data.data(), size) == crc32c_bitwise(data.substr(0, size));
+    }
+    check(bitwise, "crc32c against the bitwise definition");
+    check(crc32c::compute_parallel(data.data(), data.size(), 4, 4096) == crc32c::compute(data.data(), data.size()),
+          "crc32c parallel equals sequential");
+    check(crc32c::combine(crc32c::compute(data.data(), 1000), crc32c::compute(data.data() + 1000, 5000), 5000) ==
+              crc32c::compute(data.data(), 6000),
+          "crc32c combine");
+
+    struct answer {
+        std::size_t size;
+        hash128 digest;
+    };
+    const answer answers[]{
+        { 0, { 0xB30B389A86737AE1ULL, 0xF075C3F78E1CED4BULL } },
+        { 1, { 0xDC6D4C180DCBBB2FULL, 0x69EBD92E441DBA26ULL } },
+        { 3, { 0xCB7A1616CEB341A5ULL, 0x4EF33F9F54EC9245ULL } },
+        { 63, { 0x1FE2C7689C91B033ULL, 0x814DC96F1F05690EULL } },
+        { 64, { 0xC8991ADA4EFDB111ULL, 0xBD1E59D9204A732BULL } },
+        { 65, { 0xDFF361AE00988971ULL, 0x9569A5D0D9F8AB53ULL } },
+        { 1024, { 0x497909748EDA2CAAULL, 0x12D061D129E4D92CULL } },
+        { 1025, { 0x27B9C71EB24488D2ULL, 0xB59C8B88FA4BE8B8ULL } },
+        { 100000, { 0x39383DF267F90FCBULL, 0x05DF96737C94AF99ULL } },
+        { 1 << 20, { 0x6CF4E7AF09FC6533ULL, 0x6714DAB8F2AFE23FULL } },
+    };
+    for (const answer& item : answers) {
+        std::string what{"fast_hash of " + std::to_string(item.size) + " bytes"};
+        check(fast_hash::compute(data.data(), item.size) == item.digest, what.c_str());
+    }
+    check(fast_hash::compute(data.data(), 1000, 42) == hash128{ 0xF1AB7ECC30F121EBULL, 0x22D9CC734DF8BAACULL },
+          "fast_hash with a seed");
+
+    fast_hash state;
+    for (std::size_t done{}, step{1}; done < 100000; done += step, step = step * 3 % 257 + 1)
+        state.update(data.data() + done, std::min(step, 100000 - done));
+    check(state.digest() == answers[8].digest, "fast_hash fed in pieces");
+}
+
+void utf8_answers() {
+    using namespace tools::unicode;
+
+    const char* valid[]{
+        "", "abc", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x90\x8D\x88", "\xF4\x8F\xBF\xBF",
+        "\xED\x9F\xBF", "\xEE\x80\x80", "\xEF\xBF\xBF", "\xC2\x80", "\xDF\xBF"
+    };
+    const char* invalid[]{
+        "\x80", "\xBF", "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF", "\xED\xA0\x80",
+        "\xED\xBF\xBF", "\xF0\x80\x80\x80", "\xF0\x8F\xBF\xBF", "\xF4\x90\x80\x80", "\xF5\x80\x80\x80",
+        "\xFE", "\xFF", "\xE2\x82", "\xC3" "a", "\xF0\x90\x8D"
+    };
+
+    // Each sequence at the block edges of the 32-byte vector path
+    for (std::size_t at : {0, 1, 30, 31, 32, 61, 62, 63, 64}) {
+        for (const char* text : valid) {
+            std::string input(at, 'x');
+            input.append(text);
+            input.append(70, 'y');
+            std::string what{"valid UTF-8 at offset " + std::to_string(at)};
+            check(validate_utf8(input), what.c_str());
+        }
+        for (const char* text : invalid) {
+            std::string input(at, 'x');
+            input.append(text);
+            std::string what{"invalid UTF-8 at offset " + std::to_string(at)};
+            check(!validate_utf8(input), what.c_str());
+            input.append(70, 'y');
+            check(!validate_utf8(input), what.c_str());
+        }
+    }
+
+    std::mt19937 engine(2024);
+    const std::string pieces[]{ "a", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\xED\x9F\xBF", "\n" };
+    bool agrees{true};
+    bool split{true};
+    for (int round{}; round < 2000; ++round) {
+        std::string text;
+        for (std::size_t count{engine() % 120}; count; --count)
+            text.append(pieces[engine() % std::size(pieces)]);
+        if (round % 2 && !text.empty())
+            text[engine() % text.size()] = static_cast<char>(engine());
+        bool expected{utf8_reference(text)};
+        agrees = agrees && validate_utf8(text) == expected;
+#if defined(__x86_64__) && defined(__GNUC__)
+        if (tools::simd::has_avx2()) {
+            agrees = agrees && detail::validate_avx2(text.data(), text.size()) ==
+                               detail::validate_scalar(reinterpret_cast<const unsigned char*>(text.data()), text.size());
+        }
+#endif
+
+        utf8_validator validator;
+        std::size_t cut{text.empty() ? 0 : engine() % text.size()};
+        validator.update(std::string_view(text).substr(0, cut));
+        validator.update(std::string_view(text).substr(cut));
+        split = split && validator.finish() == expected;
+    }
+    check(agrees, "UTF-8 validation against the reference");
+    check(split, "UTF-8 validation of a split input");
+
+    std::string mixed{"plain ASCII that is long enough for the vector path, \xC3\xA9t\xC3\xA9 \xE2\x82\xAC \xF0\x90\x8D\x88"};
+    check(utf8_to_utf16(mixed) == u"plain ASCII that is long enough for the vector path, \u00E9t\u00E9 \u20AC \U00010348",
+          "UTF-8 to UTF-16");
+    check(utf8_to_utf32(mixed) == U"plain ASCII that is long enough for the vector path, \u00E9t\u00E9 \u20AC \U00010348",
+          "UTF-8 to UTF-32");
+    check(utf16_to_utf8(utf8_to_utf16(mixed)) == mixed, "UTF-16 round trip");
+    check(utf32_to_utf8(utf8_to_utf32(mixed)) == mixed, "UTF-32 round trip");
+    check(latin1_to_utf8("caf\xE9") == "caf\xC3\xA9", "Latin-1 to UTF-8");
+    check(utf8_to_latin1("caf\xC3\xA9") == "caf\xE9", "UTF-8 to Latin-1");
+
+    bool threw{};
+    try {
+        utf8_to_utf16("\xED\xA0\x80");
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    check(threw, "transcoding rejects a surrogate");
+}
+} // namespace
+
+int main() {
+    hash_answers();
+    utf8_answers();
+
+    if (failures) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,161 @@
+/*
+    Checks for the write paths: monitoring's caches follow the writes it
+    makes itself and key paths by their normal form, descriptor_cache
+    honours open-time flags, atomic_batch stays within the descriptor
+    limit, and append_writer keeps its sync promises. Files are created
+    in a tools_tests subdirectory of the temporary directory and removed
+    afterwards:
+
+        g++ -std=c++20 -O2 tests/monitoring.cpp -o monitoring -pthread && ./monitoring
+*/
+
+#include "../src/tools.hpp"
+
+#include <cstdio>
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+namespace fs = std::filesystem;
+using namespace tools::filesystem;
+
+int failures{};
+
+void check(bool condition, const char* what) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+void rewrite_cases(const fs::path& dir) {
+    monitoring files;
+    files.set_stat_cache(std::make_shared<stat_cache>());
+    files.set_content_cache(std::make_shared<content_cache>());
+
+    fs::path path{dir / "rewrite.txt"};
+    files.create_file(file_t(path, std::string("old!")));
+    check(files.read_file(path).view() == "old!", "first read");
+    files.create_file(file_t(path, std::string("NEW!")));
+    check(files.read_file(path).view() == "NEW!", "read after create_file");
+
+    files.create_file(file_t(path, std::string("safe")), durability::none);
+    check(files.read_file(path).view() == "safe", "read after an atomic create_file");
+
+    files.write_file(path, "+tail");
+    check(files.read_file(path).view() == "safe+tail", "read after write_file");
+
+    fs::path source{dir / "source.txt"};
+    files.create_file(file_t(source, std::string("copy")));
+    files.copy_file(source, path);
+    check(files.read_file(path).view() == "copy", "read after copy_file");
+}
+
+void key_cases(const fs::path& dir) {
+    fs::path saved{fs::current_path()};
+    fs::current_path(dir);
+    std::ofstream("keyed.txt") << "text";
+
+    content_cache cache;
+    metadata info{get_metadata("keyed.txt")};
+    cache.insert("keyed.txt", info, shared_buffer(std::string("text")));
+    shared_buffer buffer;
+    check(cache.lookup("./keyed.txt", info, buffer) && buffer.view() == "text", "content_cache hit through ./");
+    check(cache.lookup(dir / "keyed.txt", info, buffer), "content_cache hit through an absolute path");
+    cache.invalidate("missing/../keyed.txt");
+    check(!cache.lookup("keyed.txt", info, buffer), "content_cache invalidated through another spelling");
+
+    fs::current_path(saved);
+}
+
+#if defined(__linux__)
+void descriptor_cases(const fs::path& dir) {
+    fs::path truncated{dir / "truncated.txt"};
+    std::ofstream(truncated) << "some text";
+
+    descriptor_cache cache;
+    fs::path path{dir / "exclusive.txt"};
+    check(cache.open(path, O_WRONLY | O_CREAT | O_EXCL) != nullptr, "first exclusive create");
+    errno = 0;
+    check(cache.open(path, O_WRONLY | O_CREAT | O_EXCL) == nullptr && errno == EEXIST, "second exclusive create");
+
+    check(cache.open(truncated, O_WRONLY | O_TRUNC) != nullptr && fs::file_size(truncated) == 0,
+          "first truncating open");
+    std::ofstream(truncated) << "some text";
+    check(cache.open(truncated, O_WRONLY | O_TRUNC) != nullptr && fs::file_size(truncated) == 0,
+          "second truncating open");
+
+    monitoring files;
+    files.set_descriptor_cache(std::make_shared<descriptor_cache>());
+    fs::path log{dir / "replaced.log"};
+    files.create_file(file_t(log, std::string("one")));
+    files.write_file(log, "+a");
+    files.create_file(file_t(log, std::string("two")), durability::none);
+    files.write_file(log, "+b");
+    std::ifstream stream(log);
+    std::string text(std::istreambuf_iterator<char>(stream), {});
+    check(text == "two+b", "append after an atomic replace");
+}
+
+void batch_cases(const fs::path& dir) {
+    rlimit saved{};
+    ::getrlimit(RLIMIT_NOFILE, &saved);
+    rlimit lowered{saved};
+    lowered.rlim_cur = std::min<rlim_t>(saved.rlim_cur, 512);
+    ::setrlimit(RLIMIT_NOFILE, &lowered);
+
+    fs::create_directories(dir / "batch");
+    atomic_batch batch(durability::data);
+    bool staged{true};
+    try {
+        for (int i{}; i < 2000; ++i)
+            batch.stage(dir / "batch" / (std::to_string(i) + ".txt"), std::to_string(i));
+        batch.commit();
+    } catch (const std::exception&) {
+        staged = false;
+    }
+    ::setrlimit(RLIMIT_NOFILE, &saved);
+
+    check(staged, "batch of more files than the descriptor limit");
+    std::ifstream stream(dir / "batch" / "1999.txt");
+    std::string text(std::istreambuf_iterator<char>(stream), {});
+    check(batch.published() == 2000 && text == "1999", "every file of a large batch published");
+}
+#endif
+
+void append_writer_cases(const fs::path& dir) {
+    append_writer::options options;
+    options.sync = append_writer::sync_policy::interval;
+    options.sync_interval = std::chrono::milliseconds(100);
+    options.flush_interval = std::chrono::milliseconds(10);
+
+    append_writer writer(dir / "append.log", options);
+    writer.append("one\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    check(writer.synced() == 1, "interval sync of a lone append");
+}
+} // namespace
+
+int main() {
+    fs::path dir{fs::temp_directory_path() / "tools_tests"};
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    rewrite_cases(dir);
+    key_cases(dir);
+#if defined(__linux__)
+    descriptor_cases(dir);
+    batch_cases(dir);
+#endif
+    append_writer_cases(dir);
+
+    fs::remove_all(dir);
+    if (failures) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}